@@ -1,10 +1,25 @@
 #include "asset_manager.hpp"
 
+#include <atomic>
+#include <memory>
 #include <optional>
 
-void AssetManager::_thread_func() {
+#include "lr2/debug/profiler.hpp"
+
+// Trace detail for a key, skips building the string when nothing is recording
+static String _trace_detail(const AssetKey& key) {
+	if (!Profiler::get_singleton().is_enabled())
+		return String();
+	return key.path + " (" + key.type + ")";
+}
+
+void AssetManager::_thread_func(int index) {
+	Profiler::get_singleton().set_thread_name("Asset worker " + itos(index));
 	while (true) {
-		wake_semaphore.acquire();
+		{
+			PROFILE_SCOPE("Idle");
+			wake_semaphore.acquire();
+		}
 		if (shut_down)
 			return;
 		_find_work();
@@ -14,6 +29,10 @@ void AssetManager::_thread_func() {
 
 // Caller should acquire wake_semaphore before calling this function
 void AssetManager::_find_work() {
+	// Generic tasks are usually helping a loader that is already running, so do them first
+	if (_do_task())
+		return;
+
 	// Find some work to do
 	asset_cache_mutex.lock_shared(); // The asset_cache shouldn't move while we're reading it.
 	for (auto& a : asset_cache) {
@@ -34,6 +53,8 @@ void AssetManager::_find_work() {
 }
 
 void AssetManager::_do_work(const AssetKey& key, bool asset_cache_locked) {
+	// Covers waiting on a remapped key too, the loader's own scope is nested inside
+	Profiler::Scope work_scope("Work", _trace_detail(key));
 
 	// Let others know that we're working on it
 	if (!asset_cache_locked) {
@@ -53,11 +74,7 @@ void AssetManager::_do_work(const AssetKey& key, bool asset_cache_locked) {
 	loader_mutex.unlock_shared();
 
 	if (loader.is_null()) {
-		asset_cache_mutex.lock_shared();
-		asset_cache[key].mutex.lock();
-		asset_cache[key].state = AssetCache::State::FAILED;
-		asset_cache[key].mutex.unlock();
-		asset_cache_mutex.unlock_shared();
+		_finish_work(key, Ref<RefCounted>(), AssetCache::State::FAILED);
 		print_error("Could not find loader for {" + key.path + ", " + key.type + "}");
 		return;
 	}
@@ -66,18 +83,142 @@ void AssetManager::_do_work(const AssetKey& key, bool asset_cache_locked) {
 	AssetKey remap_key = loader->remap_key(key, custom_fs);
 	if (key == remap_key) {
 		// No remap, let's load it!
+		Profiler::Scope scope(loader->get_class(), _trace_detail(key));
 		asset = loader->load(key, custom_fs, *this);
 	} else {
 		// Remap needed
+		Profiler::Scope scope("Remap", _trace_detail(remap_key));
 		asset = block_get(remap_key);
 	}
 
+	_finish_work(key, asset, AssetCache::State::COMPLETE);
+}
+
+void AssetManager::_finish_work(const AssetKey& key, const Ref<RefCounted>& asset, AssetCache::State state) {
+	std::vector<std::function<void(Ref<RefCounted>)>> callbacks;
+
 	asset_cache_mutex.lock_shared();
-	asset_cache[key].mutex.lock();
-	asset_cache[key].asset = asset;
-	asset_cache[key].state = AssetCache::State::COMPLETE;
-	asset_cache[key].mutex.unlock();
+	AssetCache& cache = asset_cache[key];
+	cache.mutex.lock();
+	cache.asset = asset;
+	cache.state = state;
+	callbacks.swap(cache.callbacks);
+	cache.mutex.unlock();
 	asset_cache_mutex.unlock_shared();
+
+	if (callbacks.empty())
+		return;
+	completed_mutex.lock();
+	for (auto& c : callbacks) {
+		completed.push_back({std::move(c), asset});
+	}
+	completed_mutex.unlock();
+}
+
+void AssetManager::on_complete(const AssetKey& p_key, const std::function<void(Ref<RefCounted>)>& callback) {
+	if (thread_pool.size() == 0) {
+		// Nothing would ever finish it in the background
+		Ref<RefCounted> asset = block_get(p_key);
+		completed_mutex.lock();
+		completed.push_back({callback, asset});
+		completed_mutex.unlock();
+		return;
+	}
+
+	AssetKey key = p_key;
+	key.path = custom_fs.canon_path(key.path);
+
+	bool wake = false;
+	asset_cache_mutex.lock();
+	if (!asset_cache.count(key)) {
+		asset_cache[key].work_semaphore.release();
+		asset_cache[key].state = AssetCache::State::QUEUED;
+		wake = true;
+	}
+	AssetCache& cache = asset_cache[key];
+	cache.mutex.lock();
+	bool done = cache.state == AssetCache::State::COMPLETE || cache.state == AssetCache::State::FAILED;
+	Ref<RefCounted> asset = cache.asset;
+	if (!done)
+		cache.callbacks.push_back(callback);
+	cache.mutex.unlock();
+	asset_cache_mutex.unlock();
+
+	if (wake)
+		wake_semaphore.release();
+	if (done) {
+		completed_mutex.lock();
+		completed.push_back({callback, asset});
+		completed_mutex.unlock();
+	}
+}
+
+void AssetManager::flush_completed() {
+	std::vector<std::pair<std::function<void(Ref<RefCounted>)>, Ref<RefCounted>>> ready;
+	completed_mutex.lock();
+	ready.swap(completed);
+	completed_mutex.unlock();
+
+	// Unlocked so callbacks can ask for more assets
+	for (auto& r : ready) {
+		r.first(r.second);
+	}
+}
+
+bool AssetManager::_do_task() {
+	task_mutex.lock();
+	if (task_queue.empty()) {
+		task_mutex.unlock();
+		return false;
+	}
+	std::function<void()> task = std::move(task_queue.front());
+	task_queue.pop_front();
+	task_mutex.unlock();
+
+	PROFILE_SCOPE("Task");
+	task();
+	return true;
+}
+
+void AssetManager::parallel_for(int count, const std::function<void(int)>& func) {
+	if (count <= 0)
+		return;
+
+	// Shared with the helper tasks, which may only get to run after we've returned
+	struct State {
+		std::function<void(int)> func;
+		int count;
+		std::atomic<int> next{0};
+		std::atomic<int> done{0};
+	};
+	auto state = std::make_shared<State>();
+	state->func = func;
+	state->count = count;
+
+	auto run = [state]() {
+		int i;
+		while ((i = state->next.fetch_add(1)) < state->count) {
+			state->func(i);
+			state->done.fetch_add(1);
+		}
+	};
+
+	int helpers = MIN(count - 1, static_cast<int>(thread_pool.size()));
+	if (helpers > 0) {
+		task_mutex.lock();
+		for (int i = 0; i < helpers; i++) {
+			task_queue.push_back(run);
+		}
+		task_mutex.unlock();
+		wake_semaphore.release(helpers);
+	}
+
+	// Work on it ourselves rather than waiting, this also covers having no threads
+	run();
+
+	while (state->done.load() < count) {
+		std::this_thread::yield();
+	}
 }
 
 void AssetManager::vector_queue(const Vector<AssetKey>& p_keys) {
@@ -112,6 +253,30 @@ void AssetManager::_vector_queue(const Vector<AssetKey>& p_keys) {
 	wake_semaphore.release(wake);
 }
 
+AssetManager::Stats AssetManager::get_stats() {
+	Stats stats;
+	asset_cache_mutex.lock_shared();
+	for (const auto& a : asset_cache) {
+		switch (a.second.state) {
+			case AssetCache::State::INIT:
+			case AssetCache::State::QUEUED:
+				stats.queued++;
+				break;
+			case AssetCache::State::WORKING:
+				stats.working++;
+				break;
+			case AssetCache::State::COMPLETE:
+				stats.complete++;
+				break;
+			case AssetCache::State::FAILED:
+				stats.failed++;
+				break;
+		}
+	}
+	asset_cache_mutex.unlock_shared();
+	return stats;
+}
+
 void AssetManager::_canon_paths(Vector<AssetKey>& keys) {
 	for (auto& k : keys) {
 		k.path = custom_fs.canon_path(k.path);
@@ -194,6 +359,8 @@ Vector<Ref<RefCounted>> AssetManager::vector_block_get(const Vector<AssetKey>& p
 		// We got everything already!
 		return ret;
 
+	PROFILE_SCOPE("Block");
+
 	if (!new_keys.is_empty()) {
 		// Some keys haven't been queued yet
 
@@ -253,11 +420,13 @@ Vector<Ref<RefCounted>> AssetManager::vector_block_get(const Vector<AssetKey>& p
 				break;
 			}
 
+			PROFILE_SCOPE("Steal");
 			_do_work(work.value(), true);
 		}
 	}
 
-	// All done relevant work
+	// All done relevant work, anything left is being loaded by another thread
+	PROFILE_SCOPE("Wait");
 
 	while (true) {
 		Vector<int> new_not_ready;
@@ -289,12 +458,13 @@ Vector<Ref<RefCounted>> AssetManager::vector_block_get(const Vector<AssetKey>& p
 	}
 }
 
-AssetManager::AssetManager(const CustomFS& p_custom_fs) : custom_fs(p_custom_fs) {
-	uint num_threads = MAX(std::thread::hardware_concurrency() - 1, 0);
+AssetManager::AssetManager(const CustomFS& p_custom_fs, int num_threads) : custom_fs(p_custom_fs) {
+	if (num_threads < 0)
+		num_threads = MAX(int(std::thread::hardware_concurrency()) - 1, 0);
 	thread_pool.reserve(num_threads);
 
 	for (int i = 0; i < num_threads; i++) {
-		thread_pool.emplace_back(&AssetManager::_thread_func, this);
+		thread_pool.emplace_back(&AssetManager::_thread_func, this, i);
 	}
 }
 AssetManager::~AssetManager() {
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <deque>
+#include <functional>
 #include <semaphore>
+#include <shared_mutex>
 #include <thread>
 #include <unordered_map>
 #include <vector>
@@ -39,16 +42,21 @@ class AssetManager {
 	std::counting_semaphore<> wake_semaphore{0}; // Released when there is work to do
 	volatile bool shut_down = false;
 
-	void _thread_func();
+	void _thread_func(int index);
 	void _find_work(); // Caller should acquire wake_semaphore before calling this function
 	void _do_work(const AssetKey& key, bool asset_cache_locked = false);
 
+	std::deque<std::function<void()>> task_queue; // Generic jobs, taken before any queued assets
+	std::mutex task_mutex;
+	bool _do_task();
+
 	struct AssetCache {
 		enum class State { INIT, QUEUED, WORKING, COMPLETE, FAILED };
 		volatile State state = State::INIT;
 		Ref<RefCounted> asset;
 		std::mutex mutex;                        // Lock when modifying the above fields of this structure
 		std::binary_semaphore work_semaphore{0}; // Released when queued for work, acquire before doing the work.
+		std::vector<std::function<void(Ref<RefCounted>)>> callbacks; // Moved to completed when done, under mutex
 	};
 	struct Hasher {
 		size_t operator()(const AssetKey& key) const { return ((key.path) + (key.type)).hash64(); }
@@ -56,6 +64,11 @@ class AssetManager {
 	std::unordered_map<AssetKey, AssetCache, Hasher> asset_cache;
 	std::shared_mutex asset_cache_mutex;
 
+	void _finish_work(const AssetKey& key, const Ref<RefCounted>& asset, AssetCache::State state);
+
+	std::vector<std::pair<std::function<void(Ref<RefCounted>)>, Ref<RefCounted>>> completed;
+	std::mutex completed_mutex;
+
   public:
 	void vector_queue(const Vector<AssetKey>&);
 	Vector<Ref<RefCounted>> vector_try_get(const Vector<AssetKey>&);
@@ -85,6 +98,30 @@ class AssetManager {
 
 	template <class T> Ref<T> block_get(const String& p_path) { return block_get({p_path, T::get_class_static()}); }
 	Ref<RefCounted> block_get(const AssetKey& key) { return vector_block_get({key})[0]; }
+	template <class T> Vector<Ref<RefCounted>> vector_block_get(const Vector<String>& paths) {
+		return vector_block_get(_type_keys<T>(paths));
+	}
+
+	// Queues the asset and has callback called by flush_completed once it has loaded, or failed with a null asset.
+	// Lets the main thread react to finished loads without polling each one.
+	void on_complete(const AssetKey& key, const std::function<void(Ref<RefCounted>)>& callback);
+	template <class T> void on_complete(const String& p_path, const std::function<void(Ref<T>)>& callback) {
+		on_complete({p_path, T::get_class_static()}, [callback](Ref<RefCounted> asset) { callback(asset); });
+	}
+	// Calls the callbacks of everything that finished since the last flush, on this thread
+	void flush_completed();
+
+	struct Stats {
+		int queued = 0;
+		int working = 0;
+		int complete = 0;
+		int failed = 0;
+	};
+	Stats get_stats(); // Walks the whole cache, meant for debug displays
+
+	// Runs func(i) for every i in [0, count) across the pool, the calling thread helps out until all are done.
+	// Safe to call from inside AssetLoader::load.
+	void parallel_for(int count, const std::function<void(int)>& func);
 
   private:
 	Vector<Ref<AssetLoader>> loaders;
@@ -99,6 +136,8 @@ class AssetManager {
 	}
 
   public:
-	AssetManager(const CustomFS&);
+	int get_thread_count() const { return thread_pool.size(); }
+
+	AssetManager(const CustomFS&, int num_threads = -1); // -1 for one thread per spare core
 	~AssetManager();
 };
\ No newline at end of file
@@ -0,0 +1,17 @@
+#include "loaders.hpp"
+
+#include "ifl.hpp"
+#include "image_asset_loader.hpp"
+#include "mdl2.hpp"
+#include "tdf.hpp"
+#include "triangle_bvh.hpp"
+
+void add_lr2_loaders(AssetManager& assets) {
+	assets.add_loader<ImageAssetLoader>();
+	assets.add_loader<ImageTextureLoader>();
+	assets.add_loader<IFLLoader>();
+	assets.add_loader<MDL2Loader>();
+	assets.add_loader<TDFLoader>();
+	assets.add_loader<TDFMeshLoader>();
+	assets.add_loader<MeshBVHLoader>();
+}
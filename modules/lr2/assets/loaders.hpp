@@ -0,0 +1,6 @@
+#pragma once
+
+#include "asset_manager.hpp"
+
+// Every loader needed for LR2's game data, in the order they should be tried
+void add_lr2_loaders(AssetManager&);
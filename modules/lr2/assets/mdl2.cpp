@@ -3,7 +3,7 @@
 #include "core/io/file_access.h"
 #include "scene/resources/mesh.h"
 
-#include "lr2/io/file_helper.hpp"
+#include "lr2/io/byte_cursor.hpp"
 
 enum class MDL2Chunk : uint32_t {
 	END = 0,
@@ -50,20 +50,21 @@ struct MDL2Material {
 	uint64_t anim_name;
 };
 
-void load_vertices(Ref<FileAccess> f, Array* group_arrays) {
-	auto vertex_vector_offset = f->get_32();
-	auto vertex_normal_offset = f->get_32();
-	auto vertex_colour_offset = f->get_32();
-	auto vertex_texcoord_offset = f->get_32();
+void load_vertices(ByteCursor& c, Array* group_arrays) {
+	auto vertex_vector_offset = c.get_32();
+	auto vertex_normal_offset = c.get_32();
+	auto vertex_colour_offset = c.get_32();
+	auto vertex_texcoord_offset = c.get_32();
 
-	auto vertex_size = f->get_32();
+	auto vertex_size = c.get_32();
 
-	auto texcoord_count = f->get_32();
+	auto texcoord_count = c.get_32();
 
-	VertexFlag flags = static_cast<VertexFlag>(f->get_16());
-	auto vertices_count = f->get_16();
+	VertexFlag flags = static_cast<VertexFlag>(c.get_16());
+	auto vertices_count = c.get_16();
 
-	auto start_position = f->get_position() + 12;
+	c.skip(12);
+	ByteCursor v = c.get_chunk(uint64_t(vertices_count) * vertex_size);
 
 	Vector<Vector3> vectors;
 	vectors.resize(vertices_count);
@@ -76,24 +77,30 @@ void load_vertices(Ref<FileAccess> f, Array* group_arrays) {
 	Vector<Vector2> uv2;
 	uv2.resize(vertices_count);
 
+	Vector3* vectors_w = vectors.ptrw();
+	Vector3* normals_w = normals.ptrw();
+	Color* colours_w = colours.ptrw();
+	Vector2* uv_w = uv.ptrw();
+	Vector2* uv2_w = uv2.ptrw();
+
 	for (int vertex = 0; vertex < vertices_count; vertex++) {
 		if (has_flag(flags, VertexFlag::Vector)) {
-			f->seek(start_position + vertex * vertex_size + vertex_vector_offset);
-			vectors.set(vertex, get_vector3(f));
+			v.seek(vertex * vertex_size + vertex_vector_offset);
+			vectors_w[vertex] = v.get_vector3();
 		}
 		if (has_flag(flags, VertexFlag::Normal)) {
-			f->seek(start_position + vertex * vertex_size + vertex_normal_offset);
-			normals.set(vertex, get_vector3(f));
+			v.seek(vertex * vertex_size + vertex_normal_offset);
+			normals_w[vertex] = v.get_vector3();
 		}
 		if (has_flag(flags, VertexFlag::Colour)) {
-			f->seek(start_position + vertex * vertex_size + vertex_colour_offset);
-			colours.set(vertex, get_colour(f));
+			v.seek(vertex * vertex_size + vertex_colour_offset);
+			colours_w[vertex] = v.get_colour();
 		}
 		if (has_flag(flags, VertexFlag::UV)) {
-			f->seek(start_position + vertex * vertex_size + vertex_texcoord_offset);
-			uv.set(vertex, get_vector2(f));
+			v.seek(vertex * vertex_size + vertex_texcoord_offset);
+			uv_w[vertex] = v.get_vector2();
 			if (texcoord_count > 1) {
-				uv2.set(vertex, get_vector2(f));
+				uv2_w[vertex] = v.get_vector2();
 				// Godot only supports 2 sets of uv
 				// Shouldn't matter as LR2 probably doesn't either
 			}
@@ -115,8 +122,6 @@ void load_vertices(Ref<FileAccess> f, Array* group_arrays) {
 			group_arrays->set(Mesh::ArrayType::ARRAY_TEX_UV2, uv2);
 		}
 	}
-
-	f->seek(start_position + vertices_count * vertex_size);
 }
 
 bool MDL2Loader::can_handle(const AssetKey& key, const CustomFS& fs) const {
@@ -129,7 +134,15 @@ bool MDL2Loader::can_handle(const AssetKey& key, const CustomFS& fs) const {
 AssetKey MDL2Loader::remap_key(const AssetKey& k, const CustomFS&) const { return {k.path, "ArrayMesh"}; }
 Ref<RefCounted> MDL2Loader::load(const AssetKey& k, const CustomFS& fs, AssetManager& assets, Error* r_error) const {
 
-	Ref<FileAccess> f = fs.FileAccess_open(k.path, FileAccess::READ);
+	Error err;
+	Vector<uint8_t> data = fs.get_file_as_array(k.path, &err);
+	if (err != OK) {
+		if (r_error)
+			*r_error = err;
+		return nullptr;
+	}
+	// Chunks past the end read as END, so a truncated file stops there
+	ByteCursor c(data);
 
 	Ref<ArrayMesh> mesh;
 	mesh.instantiate();
@@ -138,10 +151,9 @@ Ref<RefCounted> MDL2Loader::load(const AssetKey& k, const CustomFS& fs, AssetMan
 	Vector<MDL2Material> material_props;
 
 	while (true) {
-		MDL2Chunk type = static_cast<MDL2Chunk>(f->get_32());
-		uint32_t chunk_size = f->get_32();
-
-		uint32_t next_chunk = f->get_position() + chunk_size;
+		MDL2Chunk type = static_cast<MDL2Chunk>(c.get_32());
+		uint32_t chunk_size = c.get_32();
+		ByteCursor chunk = c.get_chunk(chunk_size);
 
 		switch (type) {
 		default:
@@ -150,86 +162,82 @@ Ref<RefCounted> MDL2Loader::load(const AssetKey& k, const CustomFS& fs, AssetMan
 
 		case MDL2Chunk::MDL1:
 		case MDL2Chunk::MDL2: {
-			f->seek(f->get_position() + 12 + 8);
-			uint32_t has_bounding_box = f->get_32();
+			chunk.skip(12 + 8);
+			uint32_t has_bounding_box = chunk.get_32();
 			if (has_bounding_box)
-				f->seek(f->get_position() + 12 + 12 + 12 + 4);
-			f->seek(f->get_position() + 16 + 48);
-
-			textures.resize(f->get_32());
+				chunk.skip(12 + 12 + 12 + 4);
+			chunk.skip(16 + 48);
 
-			auto texture_start = f->get_position();
+			textures.resize(chunk.get_32());
 
 			for (int i = 0; i < textures.size(); i++) {
-				f->seek(texture_start + i * (256 + 8));
-				textures.set(i, get_string(f, 256));
+				textures.set(i, chunk.get_string(256));
+				chunk.skip(8);
 			}
 
 			assets.vector_queue<Texture2D>(textures);
 
-			f->seek(texture_start + textures.size() * (256 + 8));
-
-			material_props.resize(f->get_32());
+			material_props.resize(chunk.get_32());
 			for (int i = 0; i < material_props.size(); i++) {
 				MDL2Material m;
 				if (type == MDL2Chunk::MDL2) {
-					m.ambient = get_colour(f);
-					m.diffuse = get_colour(f);
-					m.specular = get_colour(f);
-					m.emissive = get_colour(f);
-					m.shine = f->get_float();
-					m.alpha = f->get_float();
-					m.alpha_type = f->get_32();
-					m.bitfield = f->get_32();
-					m.anim_name = f->get_64();
+					m.ambient = chunk.get_colour();
+					m.diffuse = chunk.get_colour();
+					m.specular = chunk.get_colour();
+					m.emissive = chunk.get_colour();
+					m.shine = chunk.get_float();
+					m.alpha = chunk.get_float();
+					m.alpha_type = chunk.get_32();
+					m.bitfield = chunk.get_32();
+					m.anim_name = chunk.get_64();
 				} else {
-					m.alpha_type = f->get_32();
-					auto u1 = f->get_float();
-					auto u2 = f->get_float();
-					auto u3 = f->get_float();
-					auto u4 = f->get_float();
-					auto u5 = f->get_float();
-					auto u6 = f->get_float();
+					m.alpha_type = chunk.get_32();
+					auto u1 = chunk.get_float();
+					auto u2 = chunk.get_float();
+					auto u3 = chunk.get_float();
+					auto u4 = chunk.get_float();
+					auto u5 = chunk.get_float();
+					auto u6 = chunk.get_float();
 				}
 				material_props.set(i, m);
 			}
 		} break;
 		case MDL2Chunk::GEO1: {
-			auto detail_level_count = f->get_32();
+			auto detail_level_count = chunk.get_32();
 
-			uint32_t detail_level_type = f->get_32();
-			f->get_float();
-			auto render_group_count = f->get_32();
-			f->get_64();
+			uint32_t detail_level_type = chunk.get_32();
+			chunk.get_float();
+			auto render_group_count = chunk.get_32();
+			chunk.get_64();
 
 			for (int render_group = 0; render_group < render_group_count; render_group++) {
-				f->seek(f->get_position() + 4);
-				auto material_id = f->get_16();
-				f->seek(f->get_position() + 2 + 12 + 8);
+				chunk.skip(4);
+				auto material_id = chunk.get_16();
+				chunk.skip(2 + 12 + 8);
 
 				Vector<Blend> blends;
 				blends.resize(4);
 				for (int i = 0; i < blends.size(); i++) {
 					Blend b;
-					b.effect = f->get_32();
-					b.texture_id = f->get_16();
-					b.coordinate_index = f->get_8();
-					b.tiling = f->get_8();
+					b.effect = chunk.get_32();
+					b.texture_id = chunk.get_16();
+					b.coordinate_index = chunk.get_8();
+					b.tiling = chunk.get_8();
 					blends.set(i, b);
 				}
 
 				Array group_arrays;
 				group_arrays.resize(Mesh::ArrayType::ARRAY_MAX);
 
-				load_vertices(f, &group_arrays);
+				load_vertices(chunk, &group_arrays);
 
-				f->get_32();
-				auto fill_type = f->get_32();
+				chunk.get_32();
+				auto fill_type = chunk.get_32();
 
 				Vector<int> indicies;
-				indicies.resize(f->get_32());
+				indicies.resize(chunk.get_32());
 				for (int index = indicies.size() - 1; index >= 0; index--) {
-					indicies.set(index, f->get_16());
+					indicies.set(index, chunk.get_16());
 				}
 
 				group_arrays.set(Mesh::ArrayType::ARRAY_INDEX, indicies);
@@ -294,6 +302,5 @@ Ref<RefCounted> MDL2Loader::load(const AssetKey& k, const CustomFS& fs, AssetMan
 		case MDL2Chunk::SHA0:
 			break;
 		}
-		f->seek(next_chunk);
 	}
 }
\ No newline at end of file
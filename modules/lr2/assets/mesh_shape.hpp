@@ -1,11 +0,0 @@
-#pragma once
-
-#include "asset_manager.hpp"
-
-class MeshShapeLoader : public AssetLoader {
-	GDCLASS(MeshShapeLoader, AssetLoader);
-
-	bool can_handle(const AssetKey&, const CustomFS&) const override;
-	AssetKey remap_key(const AssetKey&, const CustomFS&) const override;
-	Ref<RefCounted> load(const AssetKey&, const CustomFS&, AssetManager&, Error*) const override;
-};
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "core/object/ref_counted.h"
+
+// Anything Picker can cast rays against, shared between every instance of a model so rays are given in model space.
+// Loaded as "PickShape", each model type's loader decides which shape it gets.
+class PickShape : public RefCounted {
+	GDCLASS(PickShape, RefCounted);
+
+  public:
+	// r_distance is in multiples of dir, pass the current closest hit to only look for closer ones
+	virtual bool intersect_ray(const Vector3& from, const Vector3& dir, real_t& r_distance) const = 0;
+};
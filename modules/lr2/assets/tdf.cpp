@@ -1,5 +1,153 @@
 #include "tdf.hpp"
 
+#include "lr2/io/byte_cursor.hpp"
+
+void TDF::index_chunks() {
+	chunk_grid.resize(num_chunks * num_chunks);
+	chunk_grid.fill(-1);
+	for (int i = 0; i < chunks.size(); i++) {
+		const int x = chunks[i].pos_x / chunk_width;
+		const int z = chunks[i].pos_y / chunk_width;
+		if (x < num_chunks && z < num_chunks)
+			chunk_grid.set(z * num_chunks + x, i);
+	}
+}
+
+// Same test and bounds as TriangleBVH so both agree on what counts as a hit
+static bool _ray_triangle(
+	const Vector3& from, const Vector3& dir, const Vector3& v0, const Vector3& v1, const Vector3& v2,
+	real_t& r_distance) {
+	const Vector3 e1 = v1 - v0;
+	const Vector3 e2 = v2 - v0;
+	const Vector3 pvec = dir.cross(e2);
+	const real_t det = e1.dot(pvec);
+	if (det == 0)
+		return false;
+	const real_t inv_det = 1 / det;
+	const Vector3 tvec = from - v0;
+	const real_t u = tvec.dot(pvec) * inv_det;
+	if (u < 0 || u > 1)
+		return false;
+	const Vector3 qvec = tvec.cross(e1);
+	const real_t v = dir.dot(qvec) * inv_det;
+	if (v < 0 || u + v > 1)
+		return false;
+	const real_t t = e2.dot(qvec) * inv_det;
+	if (t <= 0 || t >= r_distance)
+		return false;
+	r_distance = t;
+	return true;
+}
+
+// The ray is inside the cell's footprint between t_min and t_max
+bool TDF::_intersect_cell(
+	int cell_x, int cell_z, const Vector3& from, const Vector3& dir, real_t t_min, real_t t_max,
+	real_t& r_distance) const {
+	const int chunk_index = chunk_grid[(cell_z / chunk_width) * num_chunks + cell_x / chunk_width];
+	if (chunk_index == -1)
+		return false;
+	const Chunk& chunk = chunks[chunk_index];
+	const int x = cell_x % chunk_width;
+	const int z = cell_z % chunk_width;
+	const Chunk::Vertex* v = chunk.verticies.ptr() + z * vertex_chunk + x;
+	// Cutouts, as in TDFMeshLoader
+	if (v[vertex_chunk + 1].flags & 0b10000000)
+		return false;
+
+	const real_t h00 = v[0].height * height_scale;
+	const real_t h10 = v[1].height * height_scale;
+	const real_t h01 = v[vertex_chunk].height * height_scale;
+	const real_t h11 = v[vertex_chunk + 1].height * height_scale;
+
+	// Most cells the ray passes are well above or below it
+	const real_t y0 = from.y + dir.y * t_min;
+	const real_t y1 = from.y + dir.y * t_max;
+	if (MIN(y0, y1) > MAX(MAX(h00, h10), MAX(h01, h11)) || MAX(y0, y1) < MIN(MIN(h00, h10), MIN(h01, h11)))
+		return false;
+
+	const int offset = chunk_width * num_chunks / 2;
+	const real_t px = chunk.pos_x + x - offset;
+	const real_t pz = chunk.pos_y + z - offset;
+	const Vector3 p00(px, h00, pz);
+	const Vector3 p10(px + 1, h10, pz);
+	const Vector3 p01(px, h01, pz + 1);
+	const Vector3 p11(px + 1, h11, pz + 1);
+
+	// Rows alternate their diagonal like the mesh, both triangles are tested to keep the closer hit
+	bool hit;
+	if (z % 2 == 0) {
+		hit = _ray_triangle(from, dir, p00, p10, p01, r_distance);
+		hit |= _ray_triangle(from, dir, p01, p10, p11, r_distance);
+	} else {
+		hit = _ray_triangle(from, dir, p00, p10, p11, r_distance);
+		hit |= _ray_triangle(from, dir, p00, p11, p01, r_distance);
+	}
+	return hit;
+}
+
+// Steps through the cells under the ray in the order it crosses them, so the first cell with a hit has the closest
+bool TDF::intersect_ray(const Vector3& from, const Vector3& dir, real_t& r_distance) const {
+	if (chunk_grid.is_empty())
+		return false;
+
+	const int width = chunk_width * num_chunks;
+	const real_t half_width = width / 2;
+
+	// Start where the ray enters the terrain's footprint
+	real_t t_enter = 0;
+	real_t t_exit = r_distance;
+	for (int axis : {Vector3::AXIS_X, Vector3::AXIS_Z}) {
+		if (dir[axis] == 0) {
+			if (from[axis] < -half_width || from[axis] > half_width)
+				return false;
+			continue;
+		}
+		real_t t0 = (-half_width - from[axis]) / dir[axis];
+		real_t t1 = (half_width - from[axis]) / dir[axis];
+		if (t0 > t1)
+			SWAP(t0, t1);
+		t_enter = MAX(t_enter, t0);
+		t_exit = MIN(t_exit, t1);
+	}
+	if (t_enter > t_exit)
+		return false;
+
+	// Grid coordinates put the first vertex of the first chunk at 0
+	const real_t grid_x = from.x + half_width;
+	const real_t grid_z = from.z + half_width;
+	int cell_x = CLAMP(int(Math::floor(grid_x + dir.x * t_enter)), 0, width - 1);
+	int cell_z = CLAMP(int(Math::floor(grid_z + dir.z * t_enter)), 0, width - 1);
+
+	const int step_x = dir.x < 0 ? -1 : 1;
+	const int step_z = dir.z < 0 ? -1 : 1;
+	// Where the ray crosses the next cell border on each axis, and how far apart those borders are
+	real_t t_next_x = dir.x != 0 ? (cell_x + (step_x > 0) - grid_x) / dir.x : INFINITY;
+	real_t t_next_z = dir.z != 0 ? (cell_z + (step_z > 0) - grid_z) / dir.z : INFINITY;
+	const real_t t_delta_x = dir.x != 0 ? step_x / dir.x : INFINITY;
+	const real_t t_delta_z = dir.z != 0 ? step_z / dir.z : INFINITY;
+
+	real_t t_cell = t_enter;
+	while (true) {
+		const real_t t_leave = MIN(MIN(t_next_x, t_next_z), t_exit);
+		if (_intersect_cell(cell_x, cell_z, from, dir, t_cell, t_leave, r_distance))
+			return true;
+		if (t_leave >= t_exit)
+			return false;
+
+		if (t_next_x < t_next_z) {
+			cell_x += step_x;
+			t_cell = t_next_x;
+			t_next_x += t_delta_x;
+		} else {
+			cell_z += step_z;
+			t_cell = t_next_z;
+			t_next_z += t_delta_z;
+		}
+		if (cell_x < 0 || cell_x >= width || cell_z < 0 || cell_z >= width)
+			return false;
+	}
+}
+
 bool TDFLoader::can_handle(const AssetKey& key, const CustomFS& fs) const {
 	if (!ClassDB::is_parent_class("TDF", key.type))
 		return false;
@@ -16,49 +164,65 @@ Ref<RefCounted> TDFLoader::load(const AssetKey& k, const CustomFS& fs, AssetMana
 
 	tdf->path = k.path;
 	String terr_data_path = k.path + "/TERRDATA.TDF";
-	Ref<FileAccess> file = fs.FileAccess_open(terr_data_path, FileAccess::READ);
+	Error err;
+	Vector<uint8_t> data = fs.get_file_as_array(terr_data_path, &err);
+	if (err != OK) {
+		if (r_error)
+			*r_error = err;
+		return nullptr;
+	}
+	ByteCursor file(data);
 
-	file->seek(0x10);
-	tdf->height_scale = file->get_float();
+	file.seek(0x10);
+	tdf->height_scale = file.get_float();
 
 	tdf->chunks.resize(tdf->num_chunks * tdf->num_chunks);
+	TDF::Chunk* chunks_w = tdf->chunks.ptrw();
+	bool truncated = false;
 	for (int i = 0; i < tdf->chunks.size(); i++) {
-		file->seek(0x3AE020 + i * 4);
-		uint32_t surface_offset = file->get_32();
+		file.seek(0x3AE020 + i * 4);
+		uint32_t surface_offset = file.get_32();
 
-		TDF::Chunk chunk;
+		TDF::Chunk& chunk = chunks_w[i];
 
-		file->seek(0x366020 + surface_offset + 3 * 4);
-		chunk.pos_x = file->get_16();
-		chunk.pos_y = file->get_16();
+		ByteCursor surface = file.sub_cursor(0x366020 + surface_offset, 0x120);
+		surface.seek(3 * 4);
+		chunk.pos_x = surface.get_16();
+		chunk.pos_y = surface.get_16();
 
-		file->seek(0x366020 + surface_offset + 0x90);
-		uint32_t verticies_offset = file->get_32();
+		surface.seek(0x90);
+		uint32_t verticies_offset = surface.get_32();
 
-		file->seek(0x20 + verticies_offset);
+		file.seek(0x20 + verticies_offset);
 		chunk.verticies.resize(tdf->vertex_chunk * tdf->vertex_chunk);
+		TDF::Chunk::Vertex* verticies_w = chunk.verticies.ptrw();
 		for (int v = 0; v < chunk.verticies.size(); v++) {
-			TDF::Chunk::Vertex vertex;
-
-			vertex.height = file->get_16();
-			vertex.normal_x = file->get_8();
-			vertex.normal_y = file->get_8();
-			vertex.normal_z = file->get_8();
-			vertex.flags = file->get_8();
-			vertex.mix_ratios = file->get_16();
-
-			chunk.verticies.set(v, vertex);
+			TDF::Chunk::Vertex& vertex = verticies_w[v];
+
+			vertex.height = file.get_16();
+			vertex.normal_x = file.get_8();
+			vertex.normal_y = file.get_8();
+			vertex.normal_z = file.get_8();
+			vertex.flags = file.get_8();
+			vertex.mix_ratios = file.get_16();
 		}
 
-		file->seek(0x366020 + surface_offset + 0x118);
-		chunk.texture0 = file->get_8();
-		chunk.texture1 = file->get_8();
-		chunk.texture2 = file->get_8();
-		chunk.texture3 = file->get_8();
+		surface.seek(0x118);
+		chunk.texture0 = surface.get_8();
+		chunk.texture1 = surface.get_8();
+		chunk.texture2 = surface.get_8();
+		chunk.texture3 = surface.get_8();
 
-		tdf->chunks.set(i, chunk);
+		truncated |= surface.has_overrun();
 	}
 
+	if (truncated || file.has_overrun()) {
+		if (r_error)
+			*r_error = ERR_FILE_CORRUPT;
+		ERR_FAIL_V_MSG(nullptr, "Truncated terrain data in " + terr_data_path);
+	}
+
+	tdf->index_chunks();
 	return tdf;
 }
 bool TDFMeshLoader::can_handle(const AssetKey& k, const CustomFS&) const {
@@ -74,28 +238,39 @@ AssetKey TDFMeshLoader::remap_key(const AssetKey& k, const CustomFS&) const { re
 Ref<Shader> tdf_shader;
 
 struct TempSurface {
+	Vector<int> chunks; // Indices into TDF::chunks using this material
 	Vector<Vector3> vertices;
-	Vector<Vector3> normals;
-	Vector<Vector2> uv;
-	Vector<bool> cutout;
-	Vector<uint8_t> mix;
+	Vector<uint8_t> custom0; // Height and normal x/y
+	Vector<uint8_t> custom1; // Normal z, flags and mix ratios
+	Vector<int> indices;
 };
 
-Ref<RefCounted> TDFMeshLoader::load(const AssetKey& k, const CustomFS&, AssetManager& assets, Error*) const {
+Ref<RefCounted> TDFMeshLoader::load(const AssetKey& k, const CustomFS&, AssetManager& assets, Error* r_error) const {
 	if (tdf_shader.is_null()) {
 		tdf_shader.instantiate();
 		tdf_shader->set_code(R"(
 		shader_type spatial;
 		render_mode blend_mix, depth_draw_opaque, cull_back, diffuse_lambert, specular_disabled, vertex_lighting;
 		varying vec4 mix;
-		void vertex() {mix = CUSTOM0;}
+		varying vec2 terrain_uv;
+		uniform float half_width; // TDF::chunk_width * TDF::num_chunks / 2
+		uniform float chunk_width;
+		void vertex() {
+			// CUSTOM0 and CUSTOM1 are the bytes of TDF::Chunk::Vertex as they are in the file
+			vec4 lo = round(CUSTOM0 * 255.0);
+			vec4 hi = round(CUSTOM1 * 255.0);
+			vec3 normal = vec3(lo.z, lo.w, hi.x);
+			NORMAL = normalize(normal - step(128.0, normal) * 256.0);
+			mix = vec4(mod(hi.z, 16.0), floor(hi.z / 16.0), mod(hi.w, 16.0), floor(hi.w / 16.0)) / 15.0;
+			terrain_uv = (VERTEX.xz + half_width) / chunk_width;
+		}
 		uniform sampler2D tex0 : source_color, hint_default_black;
 		uniform sampler2D tex1 : source_color, hint_default_black;
 		uniform sampler2D tex2 : source_color, hint_default_black;
 		uniform sampler2D tex3 : source_color, hint_default_black;
 		instance uniform vec2 texture_scale;
 		void fragment() {
-			vec2 scaled_uv = UV * texture_scale;
+			vec2 scaled_uv = terrain_uv * texture_scale;
 			ALBEDO = (mat4(
 				texture(tex0, scaled_uv),
 				texture(tex1, scaled_uv),
@@ -110,9 +285,18 @@ Ref<RefCounted> TDFMeshLoader::load(const AssetKey& k, const CustomFS&, AssetMan
 	mesh.instantiate();
 
 	Ref<TDF> tdf = assets.block_get<TDF>(k.path);
+	if (tdf.is_null()) {
+		if (r_error)
+			*r_error = ERR_CANT_ACQUIRE_RESOURCE;
+		ERR_FAIL_V_MSG(nullptr, "No terrain data for " + k.path);
+	}
 
-	HashMap<uint32_t, TempSurface> surfaces;
+	const int chunk_vertices = tdf->vertex_chunk * tdf->vertex_chunk;
 
+	// Group the chunks by material, this decides where each chunk lands in its surface
+	HashMap<uint32_t, TempSurface> surfaces;
+	Vector<int> chunk_offset; // Position of the chunk within its surface, in chunks
+	chunk_offset.resize(tdf->chunks.size());
 	for (int i = 0; i < tdf->chunks.size(); i++) {
 		const TDF::Chunk& chunk = tdf->chunks[i];
 		uint32_t mat_key = chunk.texture0 + (chunk.texture1 << 8) + (chunk.texture2 << 16) + (chunk.texture3 << 24);
@@ -120,70 +304,113 @@ Ref<RefCounted> TDFMeshLoader::load(const AssetKey& k, const CustomFS&, AssetMan
 			surfaces.insert(mat_key, TempSurface());
 		}
 		TempSurface& temp_surface = surfaces.find(mat_key)->value;
+		chunk_offset.set(i, temp_surface.chunks.size());
+		temp_surface.chunks.push_back(i);
+	}
+
+	// Allocate up front so the jobs can write straight into the surfaces
+	struct ChunkPtrs {
+		Vector3* vertices;
+		uint8_t* custom0;
+		uint8_t* custom1;
+	};
+	Vector<ChunkPtrs> chunk_ptrs;
+	chunk_ptrs.resize(tdf->chunks.size());
+	for (auto& E : surfaces) {
+		int vertex_count = E.value.chunks.size() * chunk_vertices;
+		E.value.vertices.resize(vertex_count);
+		E.value.custom0.resize(vertex_count * 4);
+		E.value.custom1.resize(vertex_count * 4);
+		for (int c = 0; c < E.value.chunks.size(); c++) {
+			int first_vertex = c * chunk_vertices;
+			chunk_ptrs.set(
+				E.value.chunks[c],
+				{E.value.vertices.ptrw() + first_vertex, E.value.custom0.ptrw() + first_vertex * 4,
+				 E.value.custom1.ptrw() + first_vertex * 4});
+		}
+	}
+
+	// Indices are only known once the cutouts are read, so each chunk gets its own list to be merged afterwards
+	Vector<Vector<int>> chunk_indices;
+	chunk_indices.resize(tdf->chunks.size());
+	Vector<int>* chunk_indices_w = chunk_indices.ptrw();
+
+	assets.parallel_for(tdf->chunks.size(), [&](int i) {
+		const TDF::Chunk& chunk = tdf->chunks[i];
+		const ChunkPtrs& ptrs = chunk_ptrs[i];
+		const int first_vertex = chunk_offset[i] * chunk_vertices;
 
 		for (int sz = 0; sz < tdf->vertex_chunk; sz++) {
 			for (int sx = 0; sx < tdf->vertex_chunk; sx++) {
 				int index = sz * tdf->vertex_chunk + sx;
 				const TDF::Chunk::Vertex& vertex = chunk.verticies[index];
 
-				temp_surface.vertices.push_back(Vector3(
+				ptrs.vertices[index] = Vector3(
 					chunk.pos_x + sx - tdf->chunk_width * tdf->num_chunks / 2, vertex.height * tdf->height_scale,
-					chunk.pos_y + sz - tdf->chunk_width * tdf->num_chunks / 2));
-				temp_surface.normals.push_back(Vector3(vertex.normal_x, vertex.normal_y, vertex.normal_z).normalized());
-				temp_surface.uv.push_back(Vector2(
-					static_cast<float>(chunk.pos_x + sx) / tdf->chunk_width,
-					static_cast<float>(chunk.pos_y + sz) / tdf->chunk_width));
-				temp_surface.cutout.push_back((vertex.flags & 0b10000000) == 0b10000000);
-				temp_surface.mix.push_back(((vertex.mix_ratios >> 0x0) & 0xf) * 0x11);
-				temp_surface.mix.push_back(((vertex.mix_ratios >> 0x4) & 0xf) * 0x11);
-				temp_surface.mix.push_back(((vertex.mix_ratios >> 0x8) & 0xf) * 0x11);
-				temp_surface.mix.push_back(((vertex.mix_ratios >> 0xc) & 0xf) * 0x11);
+					chunk.pos_y + sz - tdf->chunk_width * tdf->num_chunks / 2);
+
+				// Everything but the position is passed through untouched and unpacked by the shader
+				uint8_t* custom0 = ptrs.custom0 + index * 4;
+				custom0[0] = vertex.height;
+				custom0[1] = vertex.height >> 8;
+				custom0[2] = vertex.normal_x;
+				custom0[3] = vertex.normal_y;
+				uint8_t* custom1 = ptrs.custom1 + index * 4;
+				custom1[0] = vertex.normal_z;
+				custom1[1] = vertex.flags;
+				custom1[2] = vertex.mix_ratios;
+				custom1[3] = vertex.mix_ratios >> 8;
 			}
 		}
-	}
-
-	for (auto& E : surfaces) {
 
-		Vector<int> indices;
-		for (int c = 0; c < E.value.vertices.size() / tdf->vertex_chunk / tdf->vertex_chunk; c++) {
-			for (int z = 0; z < tdf->chunk_width; z++) {
-				for (int x = 0; x < tdf->chunk_width; x++) {
-					int base_vertex = (c * tdf->vertex_chunk * tdf->vertex_chunk) + (z * tdf->vertex_chunk + x);
-
-					if (!E.value.cutout[base_vertex + 1 + tdf->vertex_chunk]) {
-						if (z % 2 == 0) {
-							indices.push_back(base_vertex);
-							indices.push_back(base_vertex + 1);
-							indices.push_back(base_vertex + tdf->vertex_chunk);
-							indices.push_back(base_vertex + tdf->vertex_chunk);
-							indices.push_back(base_vertex + 1);
-							indices.push_back(base_vertex + 1 + tdf->vertex_chunk);
-						} else {
-							indices.push_back(base_vertex);
-							indices.push_back(base_vertex + 1);
-							indices.push_back(base_vertex + 1 + tdf->vertex_chunk);
-							indices.push_back(base_vertex);
-							indices.push_back(base_vertex + 1 + tdf->vertex_chunk);
-							indices.push_back(base_vertex + tdf->vertex_chunk);
-						}
+		Vector<int>& indices = chunk_indices_w[i];
+		for (int z = 0; z < tdf->chunk_width; z++) {
+			for (int x = 0; x < tdf->chunk_width; x++) {
+				int local_vertex = z * tdf->vertex_chunk + x;
+				int base_vertex = first_vertex + local_vertex;
+
+				if (!(chunk.verticies[local_vertex + 1 + tdf->vertex_chunk].flags & 0b10000000)) {
+					if (z % 2 == 0) {
+						indices.push_back(base_vertex);
+						indices.push_back(base_vertex + 1);
+						indices.push_back(base_vertex + tdf->vertex_chunk);
+						indices.push_back(base_vertex + tdf->vertex_chunk);
+						indices.push_back(base_vertex + 1);
+						indices.push_back(base_vertex + 1 + tdf->vertex_chunk);
+					} else {
+						indices.push_back(base_vertex);
+						indices.push_back(base_vertex + 1);
+						indices.push_back(base_vertex + 1 + tdf->vertex_chunk);
+						indices.push_back(base_vertex);
+						indices.push_back(base_vertex + 1 + tdf->vertex_chunk);
+						indices.push_back(base_vertex + tdf->vertex_chunk);
 					}
 				}
 			}
 		}
+	});
+
+	for (auto& E : surfaces) {
+		Vector<int>& indices = E.value.indices;
+		for (int c : E.value.chunks) {
+			indices.append_array(chunk_indices[c]);
+		}
 
 		Array array;
 		array.resize(ArrayMesh::ARRAY_MAX);
 		array.set(ArrayMesh::ARRAY_VERTEX, E.value.vertices);
-		array.set(ArrayMesh::ARRAY_NORMAL, E.value.normals);
-		array.set(ArrayMesh::ARRAY_TEX_UV, E.value.uv);
-		array.set(ArrayMesh::ARRAY_CUSTOM0, E.value.mix);
+		array.set(ArrayMesh::ARRAY_CUSTOM0, E.value.custom0);
+		array.set(ArrayMesh::ARRAY_CUSTOM1, E.value.custom1);
 		array.set(ArrayMesh::ARRAY_INDEX, indices);
 		mesh->add_surface_from_arrays(
 			Mesh::PRIMITIVE_TRIANGLES, array, Array(), Dictionary(),
-			Mesh::ARRAY_CUSTOM_RGBA8_UNORM << Mesh::ARRAY_FORMAT_CUSTOM0_SHIFT);
+			Mesh::ARRAY_CUSTOM_RGBA8_UNORM << Mesh::ARRAY_FORMAT_CUSTOM0_SHIFT |
+				Mesh::ARRAY_CUSTOM_RGBA8_UNORM << Mesh::ARRAY_FORMAT_CUSTOM1_SHIFT);
 
 		Ref<ShaderMaterial> mat = memnew(ShaderMaterial);
 		mat->set_shader(tdf_shader);
+		mat->set_shader_parameter("half_width", float(tdf->chunk_width * tdf->num_chunks) / 2);
+		mat->set_shader_parameter("chunk_width", float(tdf->chunk_width));
 
 		uint8_t texture0 = E.key;
 		uint8_t texture1 = E.key >> 8;
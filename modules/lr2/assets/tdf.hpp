@@ -1,12 +1,18 @@
 #pragma once
 
 #include "asset_manager.hpp"
+#include "pick_shape.hpp"
 #include "lr2/io/custom_fs.hpp"
 #include "scene/3d/mesh_instance_3d.h"
 #include "scene/resources/mesh.h"
 
-class TDF : public RefCounted {
-	GDCLASS(TDF, RefCounted);
+// Terrain heights, also picked directly by walking the grid under the ray rather than through a TriangleBVH
+class TDF : public PickShape {
+	GDCLASS(TDF, PickShape);
+
+	bool _intersect_cell(
+		int cell_x, int cell_z, const Vector3& from, const Vector3& dir, real_t t_min, real_t t_max,
+		real_t& r_distance) const;
 
   public:
 	String path;
@@ -38,6 +44,10 @@ class TDF : public RefCounted {
 	};
 
 	Vector<Chunk> chunks;
+	Vector<int> chunk_grid; // Index in chunks for each chunk_width square, -1 where there's no chunk
+
+	void index_chunks(); // Fills chunk_grid from the chunk positions, call once chunks is filled
+	bool intersect_ray(const Vector3& from, const Vector3& dir, real_t& r_distance) const override;
 };
 
 class TDFLoader : public AssetLoader {
@@ -0,0 +1,205 @@
+#include "triangle_bvh.hpp"
+
+#include <algorithm>
+
+#include "scene/resources/mesh.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TRIANGLE_BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+void TriangleBVH::_build(BuildItem* items, int count) {
+	AABB bounds(items[0].face.vertex[0], Vector3());
+	for (int i = 0; i < count; i++) {
+		for (const Vector3& v : items[i].face.vertex) {
+			bounds.expand_to(v);
+		}
+	}
+	Node node;
+	node.min = bounds.position;
+	node.max = bounds.position + bounds.size;
+
+	if (count <= leaf_size) {
+		// Unused slots are left as zero sized triangles, which never hit
+		Packet packet = {};
+		for (int i = 0; i < count; i++) {
+			const Face3& f = items[i].face;
+			Vector3 e1 = f.vertex[1] - f.vertex[0];
+			Vector3 e2 = f.vertex[2] - f.vertex[0];
+			for (int axis = 0; axis < 3; axis++) {
+				packet.v0[axis][i] = f.vertex[0][axis];
+				packet.e1[axis][i] = e1[axis];
+				packet.e2[axis][i] = e2[axis];
+			}
+		}
+		node.index = packets.size();
+		node.leaf = true;
+		nodes.push_back(node);
+		packets.push_back(packet);
+		return;
+	}
+
+	// Median split along the longest axis of the centroids
+	AABB centroid_bounds(items[0].centroid, Vector3());
+	for (int i = 1; i < count; i++) {
+		centroid_bounds.expand_to(items[i].centroid);
+	}
+	int axis = centroid_bounds.size.max_axis_index();
+	int mid = count / 2;
+	std::nth_element(items, items + mid, items + count, [axis](const BuildItem& a, const BuildItem& b) {
+		return a.centroid[axis] < b.centroid[axis];
+	});
+
+	int node_index = nodes.size();
+	node.leaf = false;
+	nodes.push_back(node);
+	_build(items, mid);
+	nodes.write[node_index].index = nodes.size();
+	_build(items + mid, count - mid);
+}
+
+void TriangleBVH::build(const Vector<Face3>& faces) {
+	nodes.clear();
+	packets.clear();
+	if (faces.is_empty())
+		return;
+
+	Vector<BuildItem> items;
+	items.resize(faces.size());
+	BuildItem* items_w = items.ptrw();
+	for (int i = 0; i < faces.size(); i++) {
+		items_w[i].face = faces[i];
+		items_w[i].centroid = (faces[i].vertex[0] + faces[i].vertex[1] + faces[i].vertex[2]) / 3;
+	}
+	_build(items_w, items.size());
+}
+
+AABB TriangleBVH::get_aabb() const {
+	if (nodes.is_empty())
+		return AABB();
+	return AABB(nodes[0].min, nodes[0].max - nodes[0].min);
+}
+
+// Möller–Trumbore against the four triangles of a packet, both faces count as a hit
+static bool intersect_packet(
+	const TriangleBVH::Packet& p, const Vector3& from, const Vector3& dir, real_t& r_distance) {
+	float t[TriangleBVH::leaf_size];
+	int hits = 0;
+
+#ifdef TRIANGLE_BVH_SSE
+	const __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+	const __m128 e1x = _mm_loadu_ps(p.e1[0]), e1y = _mm_loadu_ps(p.e1[1]), e1z = _mm_loadu_ps(p.e1[2]);
+	const __m128 e2x = _mm_loadu_ps(p.e2[0]), e2y = _mm_loadu_ps(p.e2[1]), e2z = _mm_loadu_ps(p.e2[2]);
+
+	const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	const __m128 inv_det = _mm_div_ps(_mm_set1_ps(1), det);
+
+	const __m128 tx = _mm_sub_ps(_mm_set1_ps(from.x), _mm_loadu_ps(p.v0[0]));
+	const __m128 ty = _mm_sub_ps(_mm_set1_ps(from.y), _mm_loadu_ps(p.v0[1]));
+	const __m128 tz = _mm_sub_ps(_mm_set1_ps(from.z), _mm_loadu_ps(p.v0[2]));
+	const __m128 u =
+		_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+
+	const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+	const __m128 v =
+		_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+	const __m128 dist =
+		_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+	const __m128 zero = _mm_setzero_ps();
+	// Only exactly parallel rays are skipped up front, an epsilon on det would scale with the triangle's size and miss
+	// small ones. Near parallel rays fail the range checks below.
+	__m128 mask = _mm_cmpneq_ps(det, zero);
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1)));
+	mask = _mm_and_ps(mask, _mm_cmpgt_ps(dist, zero));
+	mask = _mm_and_ps(mask, _mm_cmplt_ps(dist, _mm_set1_ps(r_distance)));
+
+	hits = _mm_movemask_ps(mask);
+	_mm_storeu_ps(t, dist);
+#else
+	for (int i = 0; i < TriangleBVH::leaf_size; i++) {
+		const Vector3 e1(p.e1[0][i], p.e1[1][i], p.e1[2][i]);
+		const Vector3 e2(p.e2[0][i], p.e2[1][i], p.e2[2][i]);
+		const Vector3 pvec = dir.cross(e2);
+		const real_t det = e1.dot(pvec);
+		if (det == 0)
+			continue;
+		const real_t inv_det = 1 / det;
+		const Vector3 tvec = from - Vector3(p.v0[0][i], p.v0[1][i], p.v0[2][i]);
+		const real_t u = tvec.dot(pvec) * inv_det;
+		if (u < 0 || u > 1)
+			continue;
+		const Vector3 qvec = tvec.cross(e1);
+		const real_t v = dir.dot(qvec) * inv_det;
+		if (v < 0 || u + v > 1)
+			continue;
+		t[i] = e2.dot(qvec) * inv_det;
+		if (t[i] > 0 && t[i] < r_distance)
+			hits |= 1 << i;
+	}
+#endif
+
+	if (!hits)
+		return false;
+	for (int i = 0; i < TriangleBVH::leaf_size; i++) {
+		if ((hits & (1 << i)) && t[i] < r_distance)
+			r_distance = t[i];
+	}
+	return true;
+}
+
+bool TriangleBVH::intersect_ray(const Vector3& from, const Vector3& dir, real_t& r_distance) const {
+	if (nodes.is_empty())
+		return false;
+
+	const Vector3 inv_dir(1 / dir.x, 1 / dir.y, 1 / dir.z);
+	bool hit = false;
+
+	// Each split halves the triangles, so 64 levels is far more than any model can need
+	uint32_t stack[64];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0) {
+		uint32_t node_index = stack[--stack_size];
+		const Node& node = nodes[node_index];
+		if (!ray_aabb(from, inv_dir, node.min, node.max, r_distance))
+			continue;
+
+		if (node.leaf) {
+			hit |= intersect_packet(packets[node.index], from, dir, r_distance);
+		} else {
+			stack[stack_size++] = node.index;
+			stack[stack_size++] = node_index + 1;
+		}
+	}
+	return hit;
+}
+
+bool MeshBVHLoader::can_handle(const AssetKey& key, const CustomFS& fs) const {
+	if (!ClassDB::is_parent_class("TriangleBVH", key.type))
+		return false;
+	// Terrain is a directory without an extension, TDFLoader gives the TDF itself as its shape
+	if (key.path.get_extension().to_lower() == "")
+		return false;
+	return true;
+}
+AssetKey MeshBVHLoader::remap_key(const AssetKey& key, const CustomFS&) const { return {key.path, "TriangleBVH"}; }
+Ref<RefCounted> MeshBVHLoader::load(const AssetKey& key, const CustomFS&, AssetManager& assets, Error*) const {
+	Ref<Mesh> mesh = assets.block_get<Mesh>(key.path);
+	if (mesh.is_null())
+		return Ref<RefCounted>();
+
+	Ref<TriangleBVH> bvh;
+	bvh.instantiate();
+	bvh->build(mesh->get_faces());
+	return bvh;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "core/math/face3.h"
+
+#include "asset_manager.hpp"
+#include "pick_shape.hpp"
+
+// Bounding volume hierarchy over the triangles of a model, used for picking.
+class TriangleBVH : public PickShape {
+	GDCLASS(TriangleBVH, PickShape);
+
+  public:
+	// Four triangles stored as structure of arrays so they can be tested at once
+	struct Packet {
+		float v0[3][4];
+		float e1[3][4];
+		float e2[3][4];
+	};
+	struct Node {
+		Vector3 min;
+		Vector3 max;
+		uint32_t index; // Internal: right child, left child is the next node. Leaf: packet index.
+		bool leaf;
+	};
+	static constexpr int leaf_size = 4;
+
+  private:
+	Vector<Node> nodes;
+	Vector<Packet> packets;
+
+	struct BuildItem {
+		Face3 face;
+		Vector3 centroid;
+	};
+	void _build(BuildItem* items, int count);
+
+  public:
+	void build(const Vector<Face3>& faces);
+	bool is_empty() const { return nodes.is_empty(); }
+	AABB get_aabb() const;
+
+	bool intersect_ray(const Vector3& from, const Vector3& dir, real_t& r_distance) const override;
+};
+
+// Whether the ray passes through an axis aligned box before max_distance
+inline bool ray_aabb(
+	const Vector3& from, const Vector3& inv_dir, const Vector3& min, const Vector3& max, real_t max_distance) {
+	real_t t_near = 0;
+	real_t t_far = max_distance;
+	for (int axis = 0; axis < 3; axis++) {
+		real_t t0 = (min[axis] - from[axis]) * inv_dir[axis];
+		real_t t1 = (max[axis] - from[axis]) * inv_dir[axis];
+		if (t0 > t1)
+			SWAP(t0, t1);
+		// Written so a NaN from a flat axis leaves the interval alone
+		if (t0 > t_near)
+			t_near = t0;
+		if (t1 < t_far)
+			t_far = t1;
+		if (t_near > t_far)
+			return false;
+	}
+	return true;
+}
+
+class MeshBVHLoader : public AssetLoader {
+	GDCLASS(MeshBVHLoader, AssetLoader);
+
+	bool can_handle(const AssetKey&, const CustomFS&) const override;
+	AssetKey remap_key(const AssetKey&, const CustomFS&) const override;
+	Ref<RefCounted> load(const AssetKey&, const CustomFS&, AssetManager&, Error*) const override;
+};
@@ -0,0 +1,140 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+
+#include "core/os/memory.h"
+#include "core/os/os.h"
+#include "core/templates/hash_set.h"
+#include "scene/resources/mesh.h"
+
+#include "lr2/assets/loaders.hpp"
+#include "lr2/assets/pick_shape.hpp"
+#include "lr2/debug/profiler.hpp"
+#include "lr2/io/custom_fs.hpp"
+#include "lr2/wrl/wrl.hpp"
+
+static String _ms(uint64_t usec) { return String::num(usec / 1000.0, 2) + " ms"; }
+static String _mib(uint64_t bytes) { return String::num(bytes / (1024.0 * 1024.0), 2) + " MiB"; }
+
+int run_benchmark(const List<String>& args) {
+	String data_dir;
+	String world_path;
+	String trace_path;
+	int threads = -1;
+	bool bvh = false;
+	for (const List<String>::Element* e = args.front(); e; e = e->next()) {
+		if (e->get() == "--benchmark" && e->next() && e->next()->next()) {
+			e = e->next();
+			data_dir = e->get();
+			e = e->next();
+			world_path = e->get();
+		} else if (e->get() == "--threads" && e->next()) {
+			e = e->next();
+			threads = e->get().to_int();
+		} else if (e->get() == "--trace" && e->next()) {
+			e = e->next();
+			trace_path = e->get();
+		} else if (e->get() == "--bvh") {
+			bvh = true;
+		}
+	}
+	if (world_path.is_empty()) {
+		print_error("Usage: -- --benchmark <data dir> <world path> [--threads N] [--bvh] [--trace <output json>]");
+		return 1;
+	}
+	ERR_FAIL_COND_V_MSG(!DirAccess::exists(data_dir), 1, "No data directory at " + data_dir);
+	const CustomFS custom_fs(data_dir);
+
+	Profiler& profiler = Profiler::get_singleton();
+	profiler.clear();
+	profiler.set_enabled(true);
+	profiler.set_thread_name("Main");
+
+	// The world is decoded on the same pool as the models
+	AssetManager assets(custom_fs, threads);
+	add_lr2_loaders(assets);
+
+	const uint64_t bytes_start = CustomFS::get_total_bytes_read();
+	const uint64_t start = OS::get_singleton()->get_ticks_usec();
+
+	Ref<WRL> wrl;
+	wrl.instantiate();
+	{
+		PROFILE_SCOPE("WRL::load");
+		Error err;
+		Ref<FileAccess> file = custom_fs.FileAccess_open(world_path, FileAccess::READ, &err);
+		ERR_FAIL_COND_V_MSG(file.is_null(), 1, "Couldn't open " + world_path);
+		err = wrl->load(file, &assets);
+		ERR_FAIL_COND_V_MSG(err != OK, 1, "Couldn't load " + world_path);
+	}
+	const uint64_t wrl_end = OS::get_singleton()->get_ticks_usec();
+
+	const Vector<WRL::EntryID>& scene = wrl->get_scene();
+	Vector<String> models;
+	HashSet<String> seen;
+	for (WRL::EntryID entry : scene) {
+		const WRL::Format::Model& model = wrl->get_entry_format(entry).model;
+		if (!model.model_id)
+			continue;
+		String path = wrl->get_entry_property(entry, model.model_id);
+		if (!path.is_empty() && !seen.has(path)) {
+			seen.insert(path);
+			models.push_back(path);
+		}
+	}
+
+	int failed = 0;
+	{
+		PROFILE_SCOPE("Load models");
+		for (const Ref<RefCounted>& mesh : assets.vector_block_get<Mesh>(models)) {
+			failed += mesh.is_null();
+		}
+		if (bvh)
+			assets.vector_block_get<PickShape>(models);
+	}
+	const int pool_size = assets.get_thread_count();
+	const uint64_t end = OS::get_singleton()->get_ticks_usec();
+	profiler.set_enabled(false);
+
+	print_line("World: " + world_path + " (" + itos(scene.size()) + " entries, " + itos(models.size()) + " models)");
+	print_line("Worker threads: " + itos(pool_size));
+	print_line("WRL load: " + _ms(wrl_end - start));
+	print_line("Model load: " + _ms(end - wrl_end) + (failed ? " (" + itos(failed) + " failed)" : ""));
+	print_line("Total: " + _ms(end - start));
+	print_line("Bytes read: " + _mib(CustomFS::get_total_bytes_read() - bytes_start));
+	print_line("Peak memory: " + _mib(Memory::get_mem_max_usage()) + " (Godot allocator, debug builds only)");
+
+	// Loader scopes are named after the loader class, so this doubles as the per loader breakdown
+	struct Total {
+		String name;
+		uint64_t usec = 0;
+		int count = 0;
+	};
+	HashMap<String, int> total_index;
+	Vector<Total> totals;
+	for (const Profiler::Event& e : profiler.get_events()) {
+		if (e.phase != 'X')
+			continue;
+		if (!total_index.has(e.name)) {
+			total_index.insert(e.name, totals.size());
+			totals.push_back({e.name});
+		}
+		Total& t = totals.write[total_index[e.name]];
+		t.usec += e.value;
+		t.count++;
+	}
+	std::sort(totals.ptrw(), totals.ptrw() + totals.size(), [](const Total& a, const Total& b) {
+		return a.usec > b.usec;
+	});
+	print_line("Time per scope, summed across threads:");
+	for (const Total& t : totals) {
+		print_line(vformat("  %-24s %12s  x%d", t.name, _ms(t.usec), t.count));
+	}
+
+	if (!trace_path.is_empty()) {
+		if (profiler.dump(trace_path) == OK)
+			print_line("Wrote trace to " + trace_path);
+	}
+	profiler.clear();
+	return failed ? 2 : 0;
+}
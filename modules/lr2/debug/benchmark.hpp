@@ -0,0 +1,11 @@
+#pragma once
+
+#include "core/string/ustring.h"
+#include "core/templates/list.h"
+
+// Opens a world without a window, loads every model it places through an AssetManager and prints where the time
+// went. The data directory stands in for the game's, so LR2_PATH isn't needed. Started from the command line with
+// user arguments:
+//   --headless -- --benchmark <data dir> <world path> [--threads N] [--bvh] [--trace <output json>]
+// Returns the process exit code.
+int run_benchmark(const List<String>& args);
@@ -0,0 +1,346 @@
+#include "generator.hpp"
+
+#include "core/io/dir_access.h"
+#include "core/io/file_access.h"
+#include "core/io/marshalls.h"
+#include "core/math/random_pcg.h"
+
+#include "lr2/io/file_helper.hpp"
+#include "lr2/wrl/wrl.hpp"
+
+static const String synthetic_dir = "/GAME DATA/SYNTHETIC";
+static const String world_path = "/GAME DATA/SAVED WORLDS/SYNTHETIC.WRL";
+
+// Layout read by TDFLoader
+const int tdf_chunks = 32 * 32;
+const int tdf_chunk_width = 16;
+const int tdf_vertex_chunk = tdf_chunk_width + 1;
+const uint64_t tdf_vertices_start = 0x20;
+const uint64_t tdf_surfaces_start = 0x366020;
+const uint64_t tdf_surface_size = 0x120;
+const uint64_t tdf_surface_table_start = 0x3AE020;
+const float tdf_height_scale = 0.002;
+
+static Ref<FileAccess> _create(const String& root, const String& path) {
+	String full_path = root.path_join(path.trim_prefix("/"));
+	DirAccess::make_dir_recursive_absolute(full_path.get_base_dir());
+	Ref<FileAccess> f = FileAccess::open(full_path, FileAccess::WRITE);
+	ERR_FAIL_COND_V_MSG(f.is_null(), f, "Couldn't create " + full_path);
+	return f;
+}
+
+static void _store_zeros(Ref<FileAccess> f, int count) {
+	for (int i = 0; i < count; i++) {
+		f->store_8(0);
+	}
+}
+
+// Uncompressed 32 bit TGA, which is also what a MIP without mipmaps looks like
+static Error _write_tga(const String& root, const String& path, int size, RandomPCG& rng) {
+	Ref<FileAccess> f = _create(root, path);
+	ERR_FAIL_COND_V(f.is_null(), ERR_CANT_CREATE);
+
+	f->store_8(0); // No id
+	f->store_8(0); // No colour map
+	f->store_8(2); // Uncompressed true colour
+	_store_zeros(f, 5);
+	f->store_16(0);
+	f->store_16(0);
+	f->store_16(size);
+	f->store_16(size);
+	f->store_8(32);
+	f->store_8(0x28); // Top left origin, 8 alpha bits
+
+	uint8_t base[3] = {uint8_t(rng.rand() % 256), uint8_t(rng.rand() % 256), uint8_t(rng.rand() % 256)};
+	Vector<uint8_t> pixels;
+	pixels.resize(size * size * 4);
+	uint8_t* w = pixels.ptrw();
+	for (int i = 0; i < size * size; i++) {
+		int x = i % size, y = i / size;
+		uint8_t shade = ((x / 8 + y / 8) % 2) ? 255 : 160;
+		for (int c = 0; c < 3; c++) {
+			w[i * 4 + c] = base[c] * shade / 255;
+		}
+		w[i * 4 + 3] = 255;
+	}
+	f->store_buffer(pixels.ptr(), pixels.size());
+	return OK;
+}
+
+// A lumpy sphere as a single MDL2 render group
+static Error _write_md2(const String& root, const String& path, const String& texture, int segments, RandomPCG& rng) {
+	Ref<FileAccess> f = _create(root, path);
+	ERR_FAIL_COND_V(f.is_null(), ERR_CANT_CREATE);
+
+	const int rings = segments;
+	const int sectors = segments * 2;
+	const float radius = rng.random(1.0f, 5.0f);
+	const float lump = rng.random(0.0f, 0.3f);
+	const float phase = rng.random(0.0f, Math_TAU);
+
+	Vector<Vector3> vertices;
+	Vector<Vector3> normals;
+	Vector<Vector2> uvs;
+	for (int r = 0; r <= rings; r++) {
+		for (int s = 0; s <= sectors; s++) {
+			float theta = Math_PI * r / rings;
+			float phi = Math_TAU * s / sectors;
+			Vector3 normal(Math::sin(theta) * Math::cos(phi), Math::cos(theta), Math::sin(theta) * Math::sin(phi));
+			float scale = radius * (1 + lump * Math::sin(3 * phi + phase) * Math::sin(2 * theta));
+			vertices.push_back(normal * scale + Vector3(0, radius, 0));
+			normals.push_back(normal);
+			uvs.push_back(Vector2(float(s) / sectors, float(r) / rings));
+		}
+	}
+	Vector<uint16_t> indices;
+	for (int r = 0; r < rings; r++) {
+		for (int s = 0; s < sectors; s++) {
+			uint16_t a = r * (sectors + 1) + s;
+			uint16_t b = a + sectors + 1;
+			indices.push_back(a);
+			indices.push_back(b);
+			indices.push_back(a + 1);
+			indices.push_back(a + 1);
+			indices.push_back(b);
+			indices.push_back(b + 1);
+		}
+	}
+
+	auto begin_chunk = [&](uint32_t type) {
+		f->store_32(type);
+		f->store_32(0); // Placeholder for length
+		return f->get_position();
+	};
+	auto end_chunk = [&](uint64_t start) {
+		uint64_t end = f->get_position();
+		f->seek(start - 4);
+		f->store_32(end - start);
+		f->seek(end);
+	};
+
+	uint64_t mdl2 = begin_chunk(0x324c444d);
+	_store_zeros(f, 12 + 8);
+	f->store_32(0); // No bounding box
+	_store_zeros(f, 16 + 48);
+	f->store_32(1);
+	store_string(f, texture, 256);
+	_store_zeros(f, 8);
+	f->store_32(1);
+	for (int i = 0; i < 4; i++) {
+		store_vector3(f, Vector3(1, 1, 1)); // Ambient, diffuse, specular and emissive
+		f->store_float(1);
+	}
+	f->store_float(0); // Shine
+	f->store_float(0); // Alpha, inverted
+	f->store_32(0);    // Alpha type
+	f->store_32(0);
+	f->store_64(0);
+	end_chunk(mdl2);
+
+	uint64_t geo1 = begin_chunk(0x314f4547);
+	f->store_32(1); // Detail levels
+	f->store_32(0);
+	f->store_float(0);
+	f->store_32(1); // Render groups
+	f->store_64(0);
+
+	_store_zeros(f, 4);
+	f->store_16(0); // Material
+	_store_zeros(f, 2 + 12 + 8);
+	for (int i = 0; i < 4; i++) {
+		f->store_32(0);
+		f->store_16(0); // Texture
+		f->store_8(0);
+		f->store_8(0);
+	}
+
+	f->store_32(0);  // Vector offset
+	f->store_32(12); // Normal offset
+	f->store_32(0);  // Colour offset
+	f->store_32(24); // Texcoord offset
+	f->store_32(32); // Vertex size
+	f->store_32(1);  // Texcoord count
+	f->store_16(1 | 2 | 8);
+	f->store_16(vertices.size());
+	_store_zeros(f, 12);
+	for (int i = 0; i < vertices.size(); i++) {
+		store_vector3(f, vertices[i]);
+		store_vector3(f, normals[i]);
+		store_vector2(f, uvs[i]);
+	}
+
+	f->store_32(0);
+	f->store_32(0); // Triangle list
+	f->store_32(indices.size());
+	for (int i = indices.size() - 1; i >= 0; i--) {
+		f->store_16(indices[i]); // MDL2Loader reads them back to front
+	}
+	end_chunk(geo1);
+
+	f->store_32(0); // END
+	f->store_32(0);
+	return OK;
+}
+
+static float _terrain_height(float x, float z, const float* phases) {
+	return 1 + 0.25 * (Math::sin(x * 0.021 + phases[0]) + Math::sin(z * 0.017 + phases[1]) +
+					   Math::sin((x + z) * 0.043 + phases[2]) + Math::sin((x - z) * 0.011 + phases[3]));
+}
+
+static Error _write_tdf(const String& root, const String& dir, int textures, int texture_size, RandomPCG& rng) {
+	for (int t = 0; t < textures; t++) {
+		Error err = _write_tga(root, dir + "/texture" + itos(t + 1) + ".tga", texture_size, rng);
+		ERR_FAIL_COND_V(err != OK, err);
+	}
+
+	Ref<FileAccess> f = _create(root, dir + "/TERRDATA.TDF");
+	ERR_FAIL_COND_V(f.is_null(), ERR_CANT_CREATE);
+
+	float phases[4];
+	for (float& p : phases) {
+		p = rng.random(0.0f, Math_TAU);
+	}
+
+	// Everything the loader doesn't read is left zeroed
+	Vector<uint8_t> data;
+	data.resize(tdf_surface_table_start + tdf_chunks * 4);
+	data.fill(0);
+	uint8_t* w = data.ptrw();
+	auto put_16 = [&](uint64_t at, uint16_t v) { encode_uint16(v, w + at); };
+	auto put_32 = [&](uint64_t at, uint32_t v) { encode_uint32(v, w + at); };
+
+	encode_float(tdf_height_scale, w + 0x10);
+
+	const int chunks_across = 32;
+	const int vertex_bytes = 8;
+	for (int i = 0; i < tdf_chunks; i++) {
+		const int pos_x = (i % chunks_across) * tdf_chunk_width;
+		const int pos_y = (i / chunks_across) * tdf_chunk_width;
+		const uint64_t surface_offset = i * tdf_surface_size;
+		const uint64_t vertices_offset = uint64_t(i) * tdf_vertex_chunk * tdf_vertex_chunk * vertex_bytes;
+
+		put_32(tdf_surface_table_start + i * 4, surface_offset);
+		put_16(tdf_surfaces_start + surface_offset + 12, pos_x);
+		put_16(tdf_surfaces_start + surface_offset + 14, pos_y);
+		put_32(tdf_surfaces_start + surface_offset + 0x90, vertices_offset);
+		w[tdf_surfaces_start + surface_offset + 0x118] = rng.rand() % textures;
+		w[tdf_surfaces_start + surface_offset + 0x119] = 0xff;
+		w[tdf_surfaces_start + surface_offset + 0x11A] = 0xff;
+		w[tdf_surfaces_start + surface_offset + 0x11B] = 0xff;
+
+		// Heights come from world coordinates so neighbouring chunks meet
+		for (int v = 0; v < tdf_vertex_chunk * tdf_vertex_chunk; v++) {
+			float x = pos_x + v % tdf_vertex_chunk;
+			float z = pos_y + v / tdf_vertex_chunk;
+			float height = _terrain_height(x, z, phases);
+			// Central differences, heights are stored times 10000 then scaled by tdf_height_scale
+			const float slope_scale = 10000 * tdf_height_scale / 2;
+			Vector3 normal =
+				Vector3(
+					(_terrain_height(x - 1, z, phases) - _terrain_height(x + 1, z, phases)) * slope_scale, 1,
+					(_terrain_height(x, z - 1, phases) - _terrain_height(x, z + 1, phases)) * slope_scale)
+					.normalized();
+
+			uint64_t at = tdf_vertices_start + vertices_offset + v * vertex_bytes;
+			put_16(at, height * 10000);
+			w[at + 2] = int8_t(normal.x * 127);
+			w[at + 3] = int8_t(normal.y * 127);
+			w[at + 4] = int8_t(normal.z * 127);
+			w[at + 5] = 0;      // No cutouts
+			put_16(at + 6, 15); // All of texture0
+		}
+	}
+
+	f->store_buffer(data.ptr(), data.size());
+	return OK;
+}
+
+int run_generator(const List<String>& args) {
+	String root;
+	int props = 1000;
+	int models = 50;
+	int model_triangles = 500;
+	int texture_size = 64;
+	int terrain_textures = 8;
+	int seed = 1;
+	for (const List<String>::Element* e = args.front(); e; e = e->next()) {
+		if (!e->next())
+			break;
+		if (e->get() == "--generate")
+			root = e->next()->get();
+		else if (e->get() == "--props")
+			props = e->next()->get().to_int();
+		else if (e->get() == "--models")
+			models = e->next()->get().to_int();
+		else if (e->get() == "--model-triangles")
+			model_triangles = e->next()->get().to_int();
+		else if (e->get() == "--texture-size")
+			texture_size = e->next()->get().to_int();
+		else if (e->get() == "--terrain-textures")
+			terrain_textures = e->next()->get().to_int();
+		else if (e->get() == "--seed")
+			seed = e->next()->get().to_int();
+	}
+	if (root.is_empty()) {
+		print_error("Usage: -- --generate <output dir> [--props N] [--models N] [--model-triangles N] "
+					"[--texture-size N] [--terrain-textures N] [--seed N]");
+		return 1;
+	}
+	models = CLAMP(models, 1, 10000);
+	terrain_textures = CLAMP(terrain_textures, 1, 255);
+	texture_size = CLAMP(texture_size, 1, 4096);
+	// Vertex counts are 16 bit
+	const int segments = CLAMP(int(Math::sqrt(model_triangles / 4.0)), 2, 127);
+
+	RandomPCG rng(seed);
+
+	// Model textures are referenced as .tga but stored as .mip, like the game's own
+	Vector<String> model_paths;
+	for (int m = 0; m < models; m++) {
+		String name = synthetic_dir + "/MODELS/MODEL" + itos(m);
+		Error err = _write_tga(root, name + ".MIP", texture_size, rng);
+		ERR_FAIL_COND_V(err != OK, 1);
+		err = _write_md2(root, name + ".MD2", name + ".tga", segments, rng);
+		ERR_FAIL_COND_V(err != OK, 1);
+		model_paths.push_back(name + ".MD2");
+	}
+
+	const String terrain_dir = synthetic_dir + "/TERRAIN";
+	ERR_FAIL_COND_V(_write_tdf(root, terrain_dir, terrain_textures, texture_size, rng) != OK, 1);
+
+	Ref<WRL> wrl;
+	wrl.instantiate();
+	{
+		HashMap<String, Variant> values;
+		values["name"] = "terrain";
+		values["model"] = terrain_dir;
+		values["rotation"] = Quaternion();
+		values["scale"] = Vector3(1, 1, 1);
+		values["texture_scale"] = Vector2(1, 1);
+		wrl->add_entry("cLegoTerrain", values);
+	}
+	{
+		HashMap<String, Variant> values;
+		values["name"] = "skybox";
+		values["model"] = model_paths[0];
+		wrl->add_entry("cSkyBox", values);
+	}
+
+	// Spread over the terrain, which spans 512 units around the origin
+	for (int p = 0; p < props; p++) {
+		HashMap<String, Variant> values;
+		values["name"] = "prop" + itos(p);
+		values["model"] = model_paths[rng.rand() % model_paths.size()];
+		values["position"] = Vector3(rng.random(-256.0f, 256.0f), rng.random(0.0f, 40.0f), rng.random(-256.0f, 256.0f));
+		values["rotation"] = Quaternion(Vector3(0, 1, 0), rng.random(0.0f, Math_TAU));
+		wrl->add_entry("cGeneralStatic", values);
+	}
+
+	Ref<FileAccess> f = _create(root, world_path);
+	ERR_FAIL_COND_V(f.is_null(), 1);
+	ERR_FAIL_COND_V(wrl->save(f) != OK, 1);
+
+	print_line(vformat(
+		"Wrote %s with %d props over %d models and a terrain to %s", world_path, props, models, root));
+	return 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "core/string/ustring.h"
+#include "core/templates/list.h"
+
+// Writes a synthetic but loadable LR2 data tree for performance testing without the game: a world of props and a
+// terrain, with the MD2 models, TDF and MIP/TGA textures they use. Started from the command line with user arguments:
+//   --headless -- --generate <output dir> [--props N] [--models N] [--model-triangles N] [--texture-size N]
+//                 [--terrain-textures N] [--seed N]
+// Benchmark it with --benchmark <output dir> "/GAME DATA/SAVED WORLDS/SYNTHETIC.WRL".
+// Returns the process exit code.
+int run_generator(const List<String>& args);
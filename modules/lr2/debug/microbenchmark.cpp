@@ -0,0 +1,177 @@
+#include "microbenchmark.hpp"
+
+#include "core/io/dir_access.h"
+#include "core/io/file_access.h"
+#include "core/io/file_access_memory.h"
+#include "core/io/marshalls.h"
+#include "core/math/random_pcg.h"
+#include "core/os/os.h"
+
+#include "lr2/io/byte_cursor.hpp"
+#include "lr2/io/file_helper.hpp"
+
+static const String floats_path = "user://lr2_microbenchmark_floats.bin";
+static const String strings_path = "user://lr2_microbenchmark_strings.bin";
+static const String write_path = "user://lr2_microbenchmark_write.bin";
+const int string_length = 24; // Same as WRL entry names, see WRL::common_properties
+
+// Results are summed into here so the reads can't be optimised away
+static volatile double sink = 0;
+
+template <typename F>
+static void _measure(const String& name, int records, int record_size, int repeat, F&& f) {
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < repeat; i++) {
+		const uint64_t start = OS::get_singleton()->get_ticks_usec();
+		sink = sink + f();
+		best = MIN(best, OS::get_singleton()->get_ticks_usec() - start);
+	}
+	const double seconds = MAX(best, uint64_t(1)) / 1000000.0;
+	print_line(vformat("  %-44s %10s ns/record %10s MiB/s", name, String::num(best * 1000.0 / records, 2),
+					   String::num(double(records) * record_size / (1024.0 * 1024.0) / seconds, 1)));
+}
+
+static Error _write_file(const String& path, const Vector<uint8_t>& data) {
+	Error err;
+	Ref<FileAccess> f = FileAccess::open(path, FileAccess::WRITE, &err);
+	ERR_FAIL_COND_V_MSG(f.is_null(), err, "Couldn't create " + path);
+	f->store_buffer(data.ptr(), data.size());
+	return OK;
+}
+
+static Ref<FileAccess> _open_memory(const Vector<uint8_t>& data) {
+	FileAccessMemory* memory = memnew(FileAccessMemory);
+	Ref<FileAccess> f(memory);
+	memory->open_custom(data.ptr(), data.size());
+	return f;
+}
+
+// Runs the same decode loop through every source, the cursor cases include reading the whole file into memory
+template <typename Helper, typename Cursor>
+static void _measure_read(const String& name, const String& path, const Vector<uint8_t>& data, int records,
+						  int record_size, int repeat, Helper&& helper, Cursor&& cursor) {
+	print_line(name + ":");
+	_measure("file_helper, FileAccess from disk", records, record_size, repeat, [&]() {
+		Ref<FileAccess> f = FileAccess::open(path, FileAccess::READ);
+		double sum = 0;
+		for (int i = 0; i < records; i++) {
+			sum += helper(f);
+		}
+		return sum;
+	});
+	_measure("file_helper, FileAccessMemory", records, record_size, repeat, [&]() {
+		Ref<FileAccess> f = _open_memory(data);
+		double sum = 0;
+		for (int i = 0; i < records; i++) {
+			sum += helper(f);
+		}
+		return sum;
+	});
+	_measure("ByteCursor, whole file read from disk", records, record_size, repeat, [&]() {
+		Vector<uint8_t> bytes = FileAccess::get_file_as_bytes(path);
+		ByteCursor c(bytes);
+		double sum = 0;
+		for (int i = 0; i < records; i++) {
+			sum += cursor(c);
+		}
+		return sum;
+	});
+	_measure("ByteCursor, buffer already in memory", records, record_size, repeat, [&]() {
+		ByteCursor c(data);
+		double sum = 0;
+		for (int i = 0; i < records; i++) {
+			sum += cursor(c);
+		}
+		return sum;
+	});
+}
+
+template <typename Helper, typename Writer>
+static void _measure_write(const String& name, int records, int record_size, int repeat, Helper&& helper,
+						   Writer&& writer) {
+	print_line(name + ":");
+	_measure("file_helper, FileAccess to disk", records, record_size, repeat, [&]() {
+		Ref<FileAccess> f = FileAccess::open(write_path, FileAccess::WRITE);
+		for (int i = 0; i < records; i++) {
+			helper(f, i);
+		}
+		return double(f->get_position());
+	});
+	_measure("ByteWriter, then one store_buffer to disk", records, record_size, repeat, [&]() {
+		ByteWriter w;
+		for (int i = 0; i < records; i++) {
+			writer(w, i);
+		}
+		Vector<uint8_t> bytes = w.finish();
+		Ref<FileAccess> f = FileAccess::open(write_path, FileAccess::WRITE);
+		f->store_buffer(bytes.ptr(), bytes.size());
+		return double(bytes.size());
+	});
+}
+
+int run_microbenchmark(const List<String>& args) {
+	int records = 1 << 20;
+	int repeat = 5;
+	for (const List<String>::Element* e = args.front(); e; e = e->next()) {
+		if (e->get() == "--records" && e->next()) {
+			e = e->next();
+			records = MAX(e->get().to_int(), 1);
+		} else if (e->get() == "--repeat" && e->next()) {
+			e = e->next();
+			repeat = MAX(e->get().to_int(), 1);
+		}
+	}
+
+	// Four floats per record covers the widest reader, the three float cases only use the start of the buffer
+	RandomPCG rng(1);
+	Vector<uint8_t> floats;
+	floats.resize(records * 16);
+	for (int i = 0; i < records * 4; i++) {
+		encode_float(rng.random(-1000.0f, 1000.0f), floats.ptrw() + i * 4);
+	}
+	Vector<String> names;
+	names.resize(records);
+	ByteWriter strings_writer;
+	for (int i = 0; i < records; i++) {
+		names.write[i] = "Entry " + itos(rng.rand());
+		strings_writer.store_string(names[i], string_length);
+	}
+	Vector<uint8_t> strings = strings_writer.finish();
+
+	ERR_FAIL_COND_V(_write_file(floats_path, floats) != OK, 1);
+	ERR_FAIL_COND_V(_write_file(strings_path, strings) != OK, 1);
+
+	print_line("Records: " + itos(records) + ", best of " + itos(repeat));
+
+	_measure_read(
+		"get_vector3", floats_path, floats, records, 12, repeat,
+		[](const Ref<FileAccess>& f) { return get_vector3(f).x; }, [](ByteCursor& c) { return c.get_vector3().x; });
+	_measure_read(
+		"get_quaternion", floats_path, floats, records, 16, repeat,
+		[](const Ref<FileAccess>& f) { return get_quaternion(f).w; },
+		[](ByteCursor& c) { return c.get_quaternion().w; });
+	_measure_read(
+		"get_colour", floats_path, floats, records, 16, repeat,
+		[](const Ref<FileAccess>& f) { return get_colour(f).a; }, [](ByteCursor& c) { return c.get_colour().a; });
+	_measure_read(
+		"get_string", strings_path, strings, records, string_length, repeat,
+		[](const Ref<FileAccess>& f) { return get_string(f, string_length).length(); },
+		[](ByteCursor& c) { return c.get_string(string_length).length(); });
+
+	const float* values = (const float*)floats.ptr();
+	_measure_write(
+		"store_vector3", records, 12, repeat,
+		[&](const Ref<FileAccess>& f, int i) {
+			store_vector3(f, Vector3(values[i * 3], values[i * 3 + 1], values[i * 3 + 2]));
+		},
+		[&](ByteWriter& w, int i) { w.store_vector3(Vector3(values[i * 3], values[i * 3 + 1], values[i * 3 + 2])); });
+	_measure_write(
+		"store_string", records, string_length, repeat,
+		[&](const Ref<FileAccess>& f, int i) { store_string(f, names[i], string_length); },
+		[&](ByteWriter& w, int i) { w.store_string(names[i], string_length); });
+
+	for (const String& path : {floats_path, strings_path, write_path}) {
+		DirAccess::remove_absolute(path);
+	}
+	return 0;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "core/string/ustring.h"
+#include "core/templates/list.h"
+
+// Times the file_helper.hpp primitives against their ByteCursor/ByteWriter equivalents on generated records, reading
+// through a file on disk, through FileAccessMemory and straight from a buffer. Started from the command line with:
+//   --headless -- --microbenchmark [--records N] [--repeat N]
+// Each case reports its fastest run. Returns the process exit code.
+int run_microbenchmark(const List<String>& args);
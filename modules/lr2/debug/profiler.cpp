@@ -0,0 +1,108 @@
+#include "profiler.hpp"
+
+#include "core/io/file_access.h"
+#include "core/os/os.h"
+
+Profiler& Profiler::get_singleton() {
+	static Profiler singleton;
+	return singleton;
+}
+
+// Threads are numbered here rather than with Thread::get_caller_id, which is the same for every std::thread such as
+// the asset workers
+static std::atomic<uint64_t> next_thread_id = 1;
+static uint64_t _thread_id() {
+	static thread_local const uint64_t id = next_thread_id++;
+	return id;
+}
+
+void Profiler::_add(Event&& event) {
+	events_mutex.lock();
+	if (events.size() < max_events)
+		events.push_back(std::move(event));
+	events_mutex.unlock();
+}
+
+void Profiler::add_scope(const String& name, const String& detail, uint64_t start_usec, uint64_t end_usec) {
+	if (!is_enabled())
+		return;
+	_add({name, detail, 'X', _thread_id(), start_usec, int64_t(end_usec - start_usec)});
+}
+
+void Profiler::add_counter(const String& name, int64_t value) {
+	if (!is_enabled())
+		return;
+	_add({name, String(), 'C', _thread_id(), OS::get_singleton()->get_ticks_usec(), value});
+}
+
+void Profiler::set_thread_name(const String& name) {
+	events_mutex.lock();
+	thread_names[_thread_id()] = name;
+	events_mutex.unlock();
+}
+
+std::vector<Profiler::Event> Profiler::get_events() {
+	events_mutex.lock();
+	std::vector<Event> ret = events;
+	events_mutex.unlock();
+	return ret;
+}
+
+Error Profiler::dump(const String& path) {
+	std::vector<Event> dumped;
+	std::unordered_map<uint64_t, String> names;
+	events_mutex.lock();
+	dumped.swap(events);
+	names = thread_names;
+	events_mutex.unlock();
+
+	Error err;
+	Ref<FileAccess> file = FileAccess::open(path, FileAccess::WRITE, &err);
+	ERR_FAIL_COND_V_MSG(file.is_null(), err, "Couldn't open " + path + " to write the trace.");
+
+	file->store_string("{\"traceEvents\":[");
+	// Separators go before every entry but the first, there might be no events or no names
+	const char* separator = "\n";
+	for (const auto& n : names) {
+		file->store_string(separator);
+		separator = ",\n";
+		file->store_string("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" + itos(n.first) +
+						   ",\"args\":{\"name\":\"" + n.second.json_escape() + "\"}}");
+	}
+	for (const Event& e : dumped) {
+		file->store_string(separator);
+		separator = ",\n";
+		String line = "{\"name\":\"" + e.name.json_escape() + "\",\"ph\":\"" + String::chr(e.phase) +
+					  "\",\"pid\":0,\"tid\":" + itos(e.thread) + ",\"ts\":" + itos(e.start_usec);
+		if (e.phase == 'X') {
+			line += ",\"dur\":" + itos(e.value);
+			if (!e.detail.is_empty())
+				line += ",\"args\":{\"detail\":\"" + e.detail.json_escape() + "\"}";
+		} else {
+			line += ",\"args\":{\"value\":" + itos(e.value) + "}";
+		}
+		line += "}";
+		file->store_string(line);
+	}
+	file->store_string("\n]}\n");
+	return OK;
+}
+
+void Profiler::clear() {
+	events_mutex.lock();
+	events.clear();
+	events_mutex.unlock();
+}
+
+Profiler::Scope::Scope(const String& p_name, const String& p_detail) {
+	if (!Profiler::get_singleton().is_enabled())
+		return;
+	name = p_name;
+	detail = p_detail;
+	start_usec = OS::get_singleton()->get_ticks_usec();
+}
+
+Profiler::Scope::~Scope() {
+	if (start_usec)
+		Profiler::get_singleton().add_scope(name, detail, start_usec, OS::get_singleton()->get_ticks_usec());
+}
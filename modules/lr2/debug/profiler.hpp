@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "core/string/ustring.h"
+
+// Records timed scopes and counters from any thread while enabled, and writes them out in Chrome's trace event
+// format so they can be opened in chrome://tracing or Perfetto.
+class Profiler {
+  public:
+	struct Event {
+		String name;
+		String detail;
+		char phase; // 'X' for a timed scope, 'C' for a counter sample
+		uint64_t thread;
+		uint64_t start_usec;
+		int64_t value; // Duration for scopes
+	};
+
+  private:
+	std::atomic<bool> enabled = false;
+	std::vector<Event> events;
+	std::mutex events_mutex;
+	std::unordered_map<uint64_t, String> thread_names; // Kept across dumps, under events_mutex
+
+	void _add(Event&&);
+
+  public:
+	static constexpr size_t max_events = 1 << 20; // Later events are dropped until the next dump or clear
+
+	static Profiler& get_singleton();
+
+	bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+	void set_enabled(bool p_enabled) { enabled.store(p_enabled, std::memory_order_relaxed); }
+
+	void add_scope(const String& name, const String& detail, uint64_t start_usec, uint64_t end_usec);
+	void add_counter(const String& name, int64_t value);
+	void set_thread_name(const String& name); // Names the calling thread's track in the trace
+
+	std::vector<Event> get_events(); // Copy of everything recorded since the last dump or clear
+	Error dump(const String& path);
+	void clear();
+
+	class Scope {
+		String name;
+		String detail;
+		uint64_t start_usec = 0;
+
+	  public:
+		Scope(const String& p_name, const String& p_detail = String());
+		~Scope();
+	};
+};
+
+#define PROFILE_SCOPE_CAT2(a, b) a##b
+#define PROFILE_SCOPE_CAT(a, b) PROFILE_SCOPE_CAT2(a, b)
+// Times the rest of the enclosing block
+#define PROFILE_SCOPE(name) Profiler::Scope PROFILE_SCOPE_CAT(_profile_scope_, __LINE__)(name)
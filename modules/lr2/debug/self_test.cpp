@@ -0,0 +1,175 @@
+#include "self_test.hpp"
+
+#include "core/math/random_pcg.h"
+
+#include "lr2/assets/tdf.hpp"
+#include "lr2/assets/triangle_bvh.hpp"
+#include "lr2/wrl/wrl.hpp"
+
+static int checks = 0;
+static int failures = 0;
+
+static void _check(bool ok, const String& what) {
+	checks++;
+	if (!ok) {
+		failures++;
+		print_error("FAILED: " + what);
+	}
+}
+
+// Follows one property of one entry, as an inspector widget does
+class PropertyWatcher : public WRL::EventHandler {
+  public:
+	Pair<WRL::EntryID, WRL::PropertyID> key;
+	int calls = 0;
+	bool removed = false;
+
+  protected:
+	void _wrl_changed(const WRL::Change& change, bool reset) override {
+		calls++;
+		for (const auto& r : change.removed) {
+			removed |= r.value == key.first;
+		}
+	}
+	Subscription get_subscription() const override { return {.properties = {key}}; }
+	bool lite_init() override { return true; }
+};
+
+static void _test_subscriptions() {
+	Ref<WRL> wrl;
+	wrl.instantiate();
+	auto add = [&](const String& name) {
+		HashMap<String, Variant> values;
+		values["name"] = name;
+		return wrl->add_entry("cGeneralStatic", values);
+	};
+	const WRL::EntryID watched = add("Watched");
+	const WRL::EntryID other = add("Other");
+
+	PropertyWatcher watcher;
+	watcher.key = {watched, WRL::name_property};
+	watcher.wrl_connect(wrl);
+	watcher.calls = 0;
+
+	auto rename = [&](WRL::EntryID entry, const String& name) {
+		WRL::Change::PropertyMap properties;
+		properties.insert({entry, WRL::name_property}, name);
+		wrl->submit_change(WRL::Change{.propertyChanges = properties});
+	};
+
+	rename(other, "Renamed");
+	_check(watcher.calls == 0, "A subscribed handler isn't sent changes to other entries");
+	rename(watched, "Renamed");
+	_check(watcher.calls == 1, "A subscribed handler is sent changes to its property");
+
+	wrl->select(other);
+	_check(watcher.calls == 2, "A subscribed handler is sent selection changes");
+
+	add("Added");
+	_check(watcher.calls == 2, "A subscribed handler isn't sent other entries being added");
+
+	wrl->clear();
+	_check(watcher.calls == 3, "A subscribed handler is sent resets");
+	_check(watcher.removed, "A subscribed handler hears when its entry is removed");
+}
+
+// The triangles TDFMeshLoader draws, as terrain was picked before TDF walked its own grid
+static Vector<Face3> _tdf_faces(const TDF& tdf) {
+	const int offset = tdf.chunk_width * tdf.num_chunks / 2;
+
+	Vector<Face3> faces;
+	for (const TDF::Chunk& chunk : tdf.chunks) {
+		auto position = [&](int x, int z) {
+			const TDF::Chunk::Vertex& vertex = chunk.verticies[z * tdf.vertex_chunk + x];
+			return Vector3(chunk.pos_x + x - offset, vertex.height * tdf.height_scale, chunk.pos_y + z - offset);
+		};
+		for (int z = 0; z < tdf.chunk_width; z++) {
+			for (int x = 0; x < tdf.chunk_width; x++) {
+				if (chunk.verticies[(z + 1) * tdf.vertex_chunk + x + 1].flags & 0b10000000)
+					continue;
+
+				if (z % 2 == 0) {
+					faces.push_back(Face3(position(x, z), position(x + 1, z), position(x, z + 1)));
+					faces.push_back(Face3(position(x, z + 1), position(x + 1, z), position(x + 1, z + 1)));
+				} else {
+					faces.push_back(Face3(position(x, z), position(x + 1, z), position(x + 1, z + 1)));
+					faces.push_back(Face3(position(x, z), position(x + 1, z + 1), position(x, z + 1)));
+				}
+			}
+		}
+	}
+	return faces;
+}
+
+static void _test_terrain_pick() {
+	RandomPCG rng(1234);
+
+	// Rough random heights with some cutouts, laid out like TDFLoader reads them
+	Ref<TDF> tdf;
+	tdf.instantiate();
+	tdf->height_scale = 0.01;
+	tdf->chunks.resize(tdf->num_chunks * tdf->num_chunks);
+	const int grid_vertices = tdf->chunk_width * tdf->num_chunks + 1;
+	Vector<uint16_t> heights;
+	heights.resize(grid_vertices * grid_vertices);
+	for (int i = 0; i < heights.size(); i++) {
+		heights.set(i, rng.rand() % 5000);
+	}
+	for (int i = 0; i < tdf->chunks.size(); i++) {
+		TDF::Chunk& chunk = tdf->chunks.write[i];
+		chunk.pos_x = (i % tdf->num_chunks) * tdf->chunk_width;
+		chunk.pos_y = (i / tdf->num_chunks) * tdf->chunk_width;
+		chunk.verticies.resize(tdf->vertex_chunk * tdf->vertex_chunk);
+		for (int v = 0; v < chunk.verticies.size(); v++) {
+			TDF::Chunk::Vertex& vertex = chunk.verticies.write[v];
+			const int x = chunk.pos_x + v % tdf->vertex_chunk;
+			const int z = chunk.pos_y + v / tdf->vertex_chunk;
+			vertex.height = heights[z * grid_vertices + x];
+			vertex.flags = rng.rand() % 10 == 0 ? 0b10000000 : 0;
+		}
+	}
+	tdf->index_chunks();
+
+	Ref<TriangleBVH> bvh;
+	bvh.instantiate();
+	bvh->build(_tdf_faces(*tdf.ptr()));
+
+	// Origins inside and outside the terrain, from steep to grazing
+	int mismatches = 0;
+	for (int i = 0; i < 2000; i++) {
+		const Vector3 from(rng.random(-300.0f, 300.0f), rng.random(0.0f, 100.0f), rng.random(-300.0f, 300.0f));
+		Vector3 dir(rng.random(-1.0f, 1.0f), rng.random(-1.0f, 0.2f), rng.random(-1.0f, 1.0f));
+		if (i % 10 == 0)
+			dir = Vector3(0, -1, 0);
+
+		real_t grid_distance = 1000;
+		real_t bvh_distance = 1000;
+		const bool grid_hit = tdf->intersect_ray(from, dir, grid_distance);
+		const bool bvh_hit = bvh->intersect_ray(from, dir, bvh_distance);
+		if (grid_hit != bvh_hit || Math::abs(grid_distance - bvh_distance) > 0.001 * MAX(1, bvh_distance))
+			mismatches++;
+	}
+	_check(mismatches == 0, "Terrain picking finds the same hits as a TriangleBVH (" + itos(mismatches) + " differ)");
+
+	// Straight down through the middle of a cutout cell, there's nothing underneath
+	const TDF::Chunk& chunk = tdf->chunks[0];
+	int cutout = 0;
+	while (!(chunk.verticies[cutout + tdf->vertex_chunk + 1].flags & 0b10000000) ||
+		   cutout % tdf->vertex_chunk == tdf->chunk_width) {
+		cutout++;
+	}
+	const int offset = tdf->chunk_width * tdf->num_chunks / 2;
+	const Vector3 above(
+		cutout % tdf->vertex_chunk + 0.5 - offset, 100, cutout / tdf->vertex_chunk + 0.5 - offset);
+	real_t distance = 1000;
+	_check(!tdf->intersect_ray(above, Vector3(0, -1, 0), distance), "Terrain picking skips cutouts");
+}
+
+int run_self_test(const List<String>& args) {
+	checks = failures = 0;
+	_test_subscriptions();
+	_test_terrain_pick();
+
+	print_line(itos(checks - failures) + " of " + itos(checks) + " checks passed");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "core/string/ustring.h"
+#include "core/templates/list.h"
+
+// Checks of behaviour that's easy to break without noticing, needing neither the game nor a window. Started from the
+// command line with:
+//   --headless -- --self-test
+// Prints every failed check. Returns the process exit code.
+int run_self_test(const List<String>& args);
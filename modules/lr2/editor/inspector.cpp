@@ -9,15 +9,24 @@ class Widget : public WRL::EventHandler {
 	void output_value(Variant value, bool commit) {
 		WRL::Change::PropertyMap propertyChanges;
 		propertyChanges.insert({field_key.first, field_key.second}, value);
-		wrl->submit_change(WRL::Change{.propertyChanges = propertyChanges});
+		const String& name = wrl->get_entry_format(field_key.first).properties[field_key.second.index].name;
+		wrl->submit_change(WRL::Change{.propertyChanges = propertyChanges}, "Set " + name);
 	}
 
   public:
 	virtual void set_enabled(bool) = 0;
-	Pair<WRL::EntryID, String> field_key;
+	Pair<WRL::EntryID, WRL::PropertyID> field_key;
 
   protected:
 	void _wrl_changed(const WRL::Change& change, bool reset) override {
+		for (const auto& r : change.removed) {
+			if (r.value == field_key.first) {
+				// Nothing left to edit, and the entry's ID may be reused by whatever is loaded next
+				set_enabled(false);
+				wrl_connect(Ref<WRL>());
+				return;
+			}
+		}
 		if (reset) {
 			if (wrl.is_valid()) {
 				Variant value = wrl->get_entry_property(field_key.first, field_key.second);
@@ -30,6 +39,7 @@ class Widget : public WRL::EventHandler {
 			input_value(change.propertyChanges.get(field_key));
 		}
 	}
+	Subscription get_subscription() const override { return {.properties = {field_key}}; }
 	bool lite_init() override { return true; }
 };
 
@@ -238,20 +248,21 @@ void Inspector::_wrl_changed(const WRL::Change& change, bool) {
 				vbox->add_child(type_label);
 			}
 
-			Vector<WRL::Format::Property> properties;
-
-			for (const auto& prop : format.properties) {
-				if (prop.name.get(0) != '_') {
-					properties.append(prop);
+			// Unnamed properties go last
+			Vector<WRL::PropertyID> properties;
+			for (int i = 0; i < format.properties.size(); i++) {
+				if (format.properties[i].name.get(0) != '_') {
+					properties.append({i});
 				}
 			}
-			for (const auto& prop : format.properties) {
-				if (prop.name.get(0) == '_') {
-					properties.append(prop);
+			for (int i = 0; i < format.properties.size(); i++) {
+				if (format.properties[i].name.get(0) == '_') {
+					properties.append({i});
 				}
 			}
 
-			for (const auto& prop : properties) {
+			for (WRL::PropertyID id : properties) {
+				const WRL::Format::Property& prop = format.properties[id.index];
 				Label* label = memnew(Label);
 				label->set_text(prop.name);
 				vbox->add_child(label);
@@ -281,7 +292,7 @@ void Inspector::_wrl_changed(const WRL::Change& change, bool) {
 					continue;
 				}
 
-				widget->field_key = {selected, prop.name};
+				widget->field_key = {selected, id};
 				vbox->add_child(dynamic_cast<Control*>(widget));
 				widget->wrl_connect(wrl);
 			}
@@ -28,7 +28,7 @@ void SceneLayout::_wrl_changed(const WRL::Change& change, bool reset) {
 
 	for (const auto& a : change.added) {
 		TreeItem* item = create_item(nullptr, a.key);
-		item->set_text(0, wrl->get_entry_property(a.value, "name"));
+		item->set_text(0, wrl->get_entry_property(a.value, WRL::name_property));
 	}
 
 	if (change.select_changed) {
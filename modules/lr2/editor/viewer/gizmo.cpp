@@ -104,6 +104,16 @@ Vector2 Gizmo::plane_position(const Vector3& mouse_origin, const Vector3& mouse_
 
 void Gizmo::mouse_over(bool over) { set_material_override(over ? active_mat : inactive_mat); }
 void Gizmo::_wrl_changed(const WRL::Change& change, bool reset) {
+	if (wrl.is_null())
+		return;
+	for (const auto& r : change.removed) {
+		if (r.value == entry) {
+			// Stops following the entry, the viewer drops the gizmo along with the selection
+			hide();
+			wrl_connect(Ref<WRL>());
+			return;
+		}
+	}
 	if (reset) {
 		set_position(wrl->get_entry_property(entry, position));
 	} else {
@@ -121,7 +131,7 @@ void Gizmo::update_scale() {
 	set_scale(one_vector * 0.15 * distance);
 }
 
-Gizmo::Gizmo(WRL::EntryID p_entry, String p_position, GizmoDir gd) : entry(p_entry), position(p_position) {
+Gizmo::Gizmo(WRL::EntryID p_entry, WRL::PropertyID p_position, GizmoDir gd) : entry(p_entry), position(p_position) {
 	set_layer_mask(LayerGizmo);
 
 	if (gizmo_mats.is_empty()) {
@@ -148,7 +158,7 @@ Gizmo::Gizmo(WRL::EntryID p_entry, String p_position, GizmoDir gd) : entry(p_ent
 	mouse_over(false);
 }
 
-Trans1DGizmo::Trans1DGizmo(WRL::EntryID entry, String position, GizmoDir gd) : Gizmo(entry, position, gd) {
+Trans1DGizmo::Trans1DGizmo(WRL::EntryID entry, WRL::PropertyID position, GizmoDir gd) : Gizmo(entry, position, gd) {
 	if (arrow_mesh.is_null()) {
 		const static Vector<Vector2> arrow_profile = {
 			{base_offset, 0},
@@ -181,15 +191,17 @@ void Trans1DGizmo::interact(const Vector3& mouse_origin, const Vector3& mouse_no
 
 	if (reset) {
 		pos_offset = skew_offset;
+		dragging = false;
 	} else {
 		WRL::Change change;
 		Vector3 pos_change = (skew_offset - pos_offset) * get_transform().basis.get_column(0).normalized();
 		change.propertyChanges.insert({entry, position}, pos_change + wrl->get_entry_property(entry, position));
-		wrl->submit_change(change);
+		wrl->submit_change(change, "Move", dragging);
+		dragging = true;
 	}
 }
 
-RotateGizmo::RotateGizmo(WRL::EntryID entry, String position, String p_rotation, GizmoDir gd)
+RotateGizmo::RotateGizmo(WRL::EntryID entry, WRL::PropertyID position, WRL::PropertyID p_rotation, GizmoDir gd)
 	: Gizmo(entry, position, gd), rotation(p_rotation) {
 	if (ring_mesh.is_null()) {
 		const static Vector<Vector2> ring_profile = {
@@ -214,6 +226,7 @@ RotateGizmo::RotateGizmo(WRL::EntryID entry, String position, String p_rotation,
 void RotateGizmo::interact(const Vector3& mouse_origin, const Vector3& mouse_normal, bool reset) {
 	if (reset) {
 		last_angle = plane_position(mouse_origin, mouse_normal).angle();
+		dragging = false;
 	} else {
 		real_t current_angle = plane_position(mouse_origin, mouse_normal).angle();
 		WRL::Change change;
@@ -221,6 +234,7 @@ void RotateGizmo::interact(const Vector3& mouse_origin, const Vector3& mouse_nor
 		change.propertyChanges.insert(
 			{entry, rotation}, rot_change * wrl->get_entry_property<Quaternion>(entry, rotation));
 		last_angle = current_angle;
-		wrl->submit_change(change);
+		wrl->submit_change(change, "Rotate", dragging);
+		dragging = true;
 	}
 }
\ No newline at end of file
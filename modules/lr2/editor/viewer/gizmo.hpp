@@ -22,7 +22,8 @@ class Gizmo : public MeshInstance3D, public WRL::EventHandler {
 
   protected:
 	WRL::EntryID entry;
-	String position;
+	WRL::PropertyID position;
+	bool dragging = false; // Past the first change of a drag, which the rest are merged into for undo
 
 	void set_shape(const Ref<Shape3D>& shape, const Transform3D& transform = Transform3D());
 
@@ -37,6 +38,7 @@ class Gizmo : public MeshInstance3D, public WRL::EventHandler {
 	}
 
   protected:
+	Subscription get_subscription() const override { return {.properties = {{entry, position}}}; }
 	bool lite_init() override { return true; }
 	void _wrl_changed(const WRL::Change&, bool reset) override;
 
@@ -44,7 +46,7 @@ class Gizmo : public MeshInstance3D, public WRL::EventHandler {
 	void update_scale();
 
   protected:
-	Gizmo(WRL::EntryID, String position, GizmoDir);
+	Gizmo(WRL::EntryID, WRL::PropertyID position, GizmoDir);
 };
 
 class Trans1DGizmo : public Gizmo {
@@ -58,7 +60,7 @@ class Trans1DGizmo : public Gizmo {
   public:
 	void interact(const Vector3& mouse_origin, const Vector3& mouse_normal, bool reset) override;
 
-	Trans1DGizmo(WRL::EntryID, String position, GizmoDir);
+	Trans1DGizmo(WRL::EntryID, WRL::PropertyID position, GizmoDir);
 };
 
 class RotateGizmo : public Gizmo {
@@ -67,12 +69,12 @@ class RotateGizmo : public Gizmo {
 	constexpr static real_t large_radius = 0.5, small_radius = 0.03;
 	constexpr static int rot_segments = 64;
 
-	String rotation;
+	WRL::PropertyID rotation;
 
 	real_t last_angle;
 
   public:
 	void interact(const Vector3& mouse_origin, const Vector3& mouse_normal, bool reset) override;
 
-	RotateGizmo(WRL::EntryID, String position, String rotation, GizmoDir);
+	RotateGizmo(WRL::EntryID, WRL::PropertyID position, WRL::PropertyID rotation, GizmoDir);
 };
\ No newline at end of file
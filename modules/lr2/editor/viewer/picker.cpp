@@ -0,0 +1,182 @@
+#include "picker.hpp"
+
+#include <algorithm>
+
+#include "lr2/assets/triangle_bvh.hpp"
+
+void Picker::_build(LeafItem* p_leaf_items, int first, int count, int parent) {
+	AABB bounds = p_leaf_items[first].world_aabb;
+	for (int i = first + 1; i < first + count; i++) {
+		bounds.merge_with(p_leaf_items[i].world_aabb);
+	}
+	Node node{bounds.position, bounds.position + bounds.size};
+	node.parent = parent;
+
+	if (count <= leaf_size) {
+		node.index = first;
+		node.count = count;
+		for (int i = first; i < first + count; i++) {
+			p_leaf_items[i].node = nodes.size();
+		}
+		nodes.push_back(node);
+		return;
+	}
+
+	int axis = bounds.size.max_axis_index();
+	int mid = count / 2;
+	std::nth_element(
+		p_leaf_items + first, p_leaf_items + first + mid, p_leaf_items + first + count,
+		[axis](const LeafItem& a, const LeafItem& b) {
+			return a.world_aabb.get_center()[axis] < b.world_aabb.get_center()[axis];
+		});
+
+	int node_index = nodes.size();
+	node.count = 0;
+	nodes.push_back(node);
+	_build(p_leaf_items, first, mid, node_index);
+	nodes.write[node_index].index = nodes.size();
+	_build(p_leaf_items, first + mid, count - mid, node_index);
+}
+
+void Picker::_rebuild() {
+	dirty = false;
+	nodes.clear();
+	leaf_items.clear();
+
+	for (auto& i : items) {
+		i.value.leaf = -1;
+		if (i.value.aabb.has_volume() || i.value.aabb.has_surface()) {
+			leaf_items.push_back({i.key, i.value.transform.xform(i.value.aabb)});
+		}
+	}
+	if (leaf_items.is_empty())
+		return;
+
+	_build(leaf_items.ptrw(), 0, leaf_items.size(), -1);
+	for (int i = 0; i < leaf_items.size(); i++) {
+		items[leaf_items[i].entry].leaf = i;
+	}
+}
+
+// The tree keeps its shape, so its bounds loosen as things move away from where they were built, until the next
+// rebuild. That's still far cheaper than rebuilding on every step of a drag.
+void Picker::_refit(int leaf) {
+	LeafItem& leaf_item = leaf_items.write[leaf];
+	const Item& item = items[leaf_item.entry];
+	leaf_item.world_aabb = item.transform.xform(item.aabb);
+
+	Node& leaf_node = nodes.write[leaf_item.node];
+	AABB bounds = leaf_items[leaf_node.index].world_aabb;
+	for (uint32_t i = leaf_node.index + 1; i < leaf_node.index + leaf_node.count; i++) {
+		bounds.merge_with(leaf_items[i].world_aabb);
+	}
+	leaf_node.min = bounds.position;
+	leaf_node.max = bounds.position + bounds.size;
+
+	for (int node_index = leaf_node.parent; node_index != -1; node_index = nodes[node_index].parent) {
+		Node& node = nodes.write[node_index];
+		const Node& left = nodes[node_index + 1];
+		const Node& right = nodes[node.index];
+		bounds = AABB(left.min, left.max - left.min);
+		bounds.merge_with(AABB(right.min, right.max - right.min));
+		node.min = bounds.position;
+		node.max = bounds.position + bounds.size;
+	}
+}
+
+// max_distance is read for every node so func can shorten the ray as it finds hits
+template <class F>
+void Picker::_traverse(const Vector3& from, const Vector3& dir, const real_t& max_distance, F func) {
+	if (dirty)
+		_rebuild();
+	if (nodes.is_empty())
+		return;
+
+	const Vector3 inv_dir(1 / dir.x, 1 / dir.y, 1 / dir.z);
+
+	// Balanced by construction, so 64 levels will never be reached
+	uint32_t stack[64];
+	int stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0) {
+		uint32_t node_index = stack[--stack_size];
+		const Node& node = nodes[node_index];
+		if (!ray_aabb(from, inv_dir, node.min, node.max, max_distance))
+			continue;
+
+		if (node.count) {
+			for (uint32_t i = node.index; i < node.index + node.count; i++) {
+				func(leaf_items[i]);
+			}
+		} else {
+			stack[stack_size++] = node.index;
+			stack[stack_size++] = node_index + 1;
+		}
+	}
+}
+
+void Picker::set_layers(WRL::EntryID entry, uint32_t layers) { items[entry].layers = layers; }
+
+void Picker::set_transform(WRL::EntryID entry, const Transform3D& transform) {
+	Item& item = items[entry];
+	item.transform = transform;
+	// A pending rebuild picks up the new transform anyway, and items without bounds aren't in the tree
+	if (!dirty && item.leaf != -1)
+		_refit(item.leaf);
+}
+
+void Picker::set_model(WRL::EntryID entry, const AABB& aabb) {
+	Item& item = items[entry];
+	item.aabb = aabb;
+	item.shape.unref();
+	dirty = true;
+}
+
+void Picker::set_shape(WRL::EntryID entry, Ref<PickShape> shape) {
+	if (shape.is_null()) {
+		// Remember the failure as an empty model instead of trying again on every click
+		shape = Ref<TriangleBVH>(memnew(TriangleBVH));
+	}
+	items[entry].shape = shape;
+}
+
+void Picker::remove(WRL::EntryID entry) {
+	items.erase(entry);
+	dirty = true;
+}
+
+void Picker::clear() {
+	items.clear();
+	dirty = true;
+}
+
+Vector<WRL::EntryID>
+Picker::get_unloaded(const Vector3& from, const Vector3& dir, real_t max_distance, uint32_t layers) {
+	const Vector3 inv_dir(1 / dir.x, 1 / dir.y, 1 / dir.z);
+	Vector<WRL::EntryID> ret;
+	_traverse(from, dir, max_distance, [&](const LeafItem& leaf) {
+		const Item& item = items[leaf.entry];
+		if (!(item.layers & layers) || item.shape.is_valid())
+			return;
+		const AABB& aabb = leaf.world_aabb;
+		if (ray_aabb(from, inv_dir, aabb.position, aabb.position + aabb.size, max_distance))
+			ret.push_back(leaf.entry);
+	});
+	return ret;
+}
+
+WRL::EntryID Picker::pick(const Vector3& from, const Vector3& dir, real_t& r_distance, uint32_t layers) {
+	WRL::EntryID found;
+	_traverse(from, dir, r_distance, [&](const LeafItem& leaf) {
+		const Item& item = items[leaf.entry];
+		if (!(item.layers & layers) || item.shape.is_null())
+			return;
+
+		// Distances stay comparable between instances as the direction isn't renormalised
+		Transform3D inv = item.transform.affine_inverse();
+		if (item.shape->intersect_ray(inv.xform(from), inv.basis.xform(dir), r_distance))
+			found = leaf.entry;
+	});
+	return found;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "core/templates/hash_map.h"
+
+#include "lr2/assets/pick_shape.hpp"
+#include "lr2/wrl/wrl.hpp"
+
+// Finds the instance under a ray without any physics bodies.
+// A BVH over the world bounds of every instance is rebuilt when instances come, go or change model, and refit when
+// one moves. The instances it reaches are then tested through the PickShape shared by their model.
+class Picker {
+  private:
+	struct Item {
+		uint32_t layers = 0;
+		Transform3D transform;
+		AABB aabb; // Model space bounds, empty until the mesh has loaded
+		Ref<PickShape> shape;
+		int leaf = -1; // In leaf_items, -1 when not in the tree
+	};
+	HashMap<WRL::EntryID, Item, WRL::EntryID::Hasher> items;
+
+	struct Node {
+		Vector3 min;
+		Vector3 max;
+		uint32_t index; // Internal: right child, left child is the next node. Leaf: first in leaf_items.
+		uint32_t count; // Zero for internal nodes
+		int parent;
+	};
+	static constexpr int leaf_size = 2;
+	Vector<Node> nodes;
+	struct LeafItem {
+		WRL::EntryID entry;
+		AABB world_aabb;
+		uint32_t node = 0;
+	};
+	Vector<LeafItem> leaf_items;
+	bool dirty = true;
+
+	void _build(LeafItem* p_leaf_items, int first, int count, int parent);
+	void _rebuild();
+	void _refit(int leaf); // Moves one item and grows or shrinks the nodes above it to match
+	template <class F> void _traverse(const Vector3& from, const Vector3& dir, const real_t& max_distance, F func);
+
+  public:
+	void set_layers(WRL::EntryID, uint32_t layers);
+	void set_transform(WRL::EntryID, const Transform3D&);
+	void set_model(WRL::EntryID, const AABB&); // Pass an empty AABB while the model is loading
+	void set_shape(WRL::EntryID, Ref<PickShape>);
+	void remove(WRL::EntryID);
+	void clear();
+
+	// Instances whose bounds the ray reaches before max_distance and whose shape hasn't been given with set_shape yet
+	Vector<WRL::EntryID> get_unloaded(const Vector3& from, const Vector3& dir, real_t max_distance, uint32_t layers);
+	// Closest hit among the instances with a shape, r_distance goes in as the maximum and comes out as the hit's
+	WRL::EntryID pick(const Vector3& from, const Vector3& dir, real_t& r_distance, uint32_t layers);
+};
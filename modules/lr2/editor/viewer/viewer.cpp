@@ -1,17 +1,18 @@
 #include "viewer.hpp"
 
+#include "core/config/project_settings.h"
 #include "scene/3d/camera_3d.h"
-#include "scene/3d/collision_shape_3d.h"
 #include "scene/3d/light_3d.h"
+#include "scene/3d/mesh_instance_3d.h"
 #include "scene/gui/subviewport_container.h"
 #include "scene/resources/primitive_meshes.h"
+#include "scene/resources/world_3d.h"
+#include "servers/physics_server_3d.h"
+#include "servers/rendering_server.h"
 
 #include "gizmo.hpp"
-#include "lr2/assets/ifl.hpp"
-#include "lr2/assets/image_asset_loader.hpp"
-#include "lr2/assets/mdl2.hpp"
-#include "lr2/assets/mesh_shape.hpp"
-#include "lr2/assets/tdf.hpp"
+#include "lr2/assets/pick_shape.hpp"
+#include "lr2/debug/profiler.hpp"
 
 void Viewer::update_cameras() {
 	bg_camera->set_basis(camera->get_basis());
@@ -26,18 +27,25 @@ void Viewer::update_gizmos(WRL::EntryID selected) {
 		g->queue_free();
 	}
 	gizmos.clear();
+	// Freed at the end of the frame, so it mustn't be hovered or dragged any more
+	current_gizmo = nullptr;
+	if (mode == Mode::Gizmo)
+		mode = Mode::Default;
 	if (selected) {
 		auto& model = wrl->get_entry_format(selected).model;
 		if (model) {
-			if (model.position != "") {
-				gizmos.append(memnew(Trans1DGizmo(selected, model.position, GizmoDir::X_AXIS)));
-				gizmos.append(memnew(Trans1DGizmo(selected, model.position, GizmoDir::Y_AXIS)));
-				gizmos.append(memnew(Trans1DGizmo(selected, model.position, GizmoDir::Z_AXIS)));
-
-				if (model.rotation != "") {
-					gizmos.append(memnew(RotateGizmo(selected, model.position, model.rotation, GizmoDir::X_AXIS)));
-					gizmos.append(memnew(RotateGizmo(selected, model.position, model.rotation, GizmoDir::Y_AXIS)));
-					gizmos.append(memnew(RotateGizmo(selected, model.position, model.rotation, GizmoDir::Z_AXIS)));
+			if (model.position_id) {
+				gizmos.append(memnew(Trans1DGizmo(selected, model.position_id, GizmoDir::X_AXIS)));
+				gizmos.append(memnew(Trans1DGizmo(selected, model.position_id, GizmoDir::Y_AXIS)));
+				gizmos.append(memnew(Trans1DGizmo(selected, model.position_id, GizmoDir::Z_AXIS)));
+
+				if (model.rotation_id) {
+					gizmos.append(
+						memnew(RotateGizmo(selected, model.position_id, model.rotation_id, GizmoDir::X_AXIS)));
+					gizmos.append(
+						memnew(RotateGizmo(selected, model.position_id, model.rotation_id, GizmoDir::Y_AXIS)));
+					gizmos.append(
+						memnew(RotateGizmo(selected, model.position_id, model.rotation_id, GizmoDir::Z_AXIS)));
 				}
 			}
 		}
@@ -49,8 +57,71 @@ void Viewer::update_gizmos(WRL::EntryID selected) {
 	update_cameras();
 }
 
+void Viewer::load_shape(WRL::EntryID entry) {
+	const String& path = instances[entry].model_path;
+	if (!pending_shapes.has(path)) {
+		pending_shapes.insert(path, Vector<WRL::EntryID>());
+		assets.on_complete<PickShape>(path, [this, path](Ref<PickShape> shape) { shape_loaded(path, shape); });
+	}
+	Vector<WRL::EntryID>& entries = pending_shapes[path];
+	if (!entries.has(entry))
+		entries.push_back(entry);
+}
+
+void Viewer::shape_loaded(const String& path, Ref<PickShape> shape) {
+	for (WRL::EntryID entry : pending_shapes[path]) {
+		// A failed load still reaches the picker, as an empty shape, so clicks don't wait on it forever
+		if (instances.has(entry) && instances[entry].model_path == path)
+			picker.set_shape(entry, shape);
+	}
+	pending_shapes.erase(path);
+}
+
+// Shapes load in the background, so when the ray reaches the bounds of instances still loading theirs before the
+// closest hit, the answer isn't known yet. Those are requested and false is returned.
+bool Viewer::pick(
+	const Vector3& ray_origin, const Vector3& ray_normal, real_t max_distance, uint32_t layers, WRL::EntryID& r_entry) {
+	PROFILE_SCOPE("Viewer::pick");
+	real_t distance = max_distance;
+	r_entry = picker.pick(ray_origin, ray_normal, distance, layers);
+
+	Vector<WRL::EntryID> unloaded = picker.get_unloaded(ray_origin, ray_normal, distance, layers);
+	for (WRL::EntryID entry : unloaded) {
+		load_shape(entry);
+	}
+	return unloaded.is_empty();
+}
+
+bool Viewer::select_click(const Click& click) {
+	WRL::EntryID found_entry;
+	if (!pick(click.origin, click.normal, camera->get_far(), LayerProps | LayerTerrain, found_entry))
+		return false;
+	if (!found_entry && !pick(click.bg_origin, click.bg_normal, bg_camera->get_far(), LayerSkyBox, found_entry))
+		return false;
+
+	if (found_entry) {
+		wrl->submit_change(WRL::Change{.select_changed = true, .select = {wrl->get_index(found_entry), found_entry}});
+	}
+	return true;
+}
+
 void Viewer::input(const Ref<InputEvent>& p_event) {
 	Ref<InputEventKey> k = p_event;
+	if (k.is_valid() && k->is_pressed() && !k->is_echo() && k->get_keycode() == Key::F3) {
+		Profiler& profiler = Profiler::get_singleton();
+		if (k->is_shift_pressed()) {
+			if (profiler.dump(trace_path) == OK)
+				print_line("Wrote profiler trace to " + ProjectSettings::get_singleton()->globalize_path(trace_path));
+		} else {
+			// Only record while the overlay is up so there's no cost otherwise
+			stats_label->set_visible(!stats_label->is_visible());
+			profiler.set_enabled(stats_label->is_visible());
+			if (!profiler.is_enabled())
+				profiler.clear();
+		}
+		get_viewport()->set_input_as_handled();
+		return;
+	}
 	if (mode == Mode::FPS && k.is_valid())
 		get_viewport()->set_input_as_handled();
 }
@@ -67,48 +138,12 @@ void Viewer::gui_input(const Ref<InputEvent>& p_event) {
 				mode = Mode::Gizmo;
 				current_gizmo->interact(ray_origin, ray_normal, true);
 			} else {
-				// Pick object under cursor
-				PhysicsDirectSpaceState3D::RayParameters ray_params{
-					.collide_with_bodies = true,
-					.collide_with_areas = true,
-					.hit_from_inside = true,
-					.hit_back_faces = true};
-				ray_params.from = ray_origin;
-				ray_params.to = ray_origin + ray_normal * camera->get_far();
-				ray_params.collision_mask = LayerProps | LayerTerrain;
-
-				PhysicsDirectSpaceState3D::RayResult rr;
-				bool found = PhysicsServer3D::get_singleton()
-								 ->space_get_direct_state(camera->get_world_3d()->get_space())
-								 ->intersect_ray(ray_params, rr);
-
-				if (!found) {
-					const Vector3 ray_origin = bg_camera->project_ray_origin(cursor_pos);
-					const Vector3 ray_normal = bg_camera->project_ray_normal(cursor_pos);
-					ray_params.from = ray_origin;
-					ray_params.to = ray_origin + ray_normal * bg_camera->get_far();
-					ray_params.collision_mask = LayerSkyBox;
-
-					found = PhysicsServer3D::get_singleton()
-								->space_get_direct_state(bg_camera->get_world_3d()->get_space())
-								->intersect_ray(ray_params, rr);
-				}
-
-				if (found) {
-					WRL::EntryID found_entry;
-
-					for (const auto& i : instances) {
-						if (i.value.collider == rr.collider) {
-							found_entry = i.key;
-							break;
-						}
-					}
-
-					if (found_entry) {
-						wrl->submit_change(
-							WRL::Change{.select_changed = true, .select = {wrl->get_index(found_entry), found_entry}});
-					}
-				}
+				// Pick object under cursor, a newer click replaces one still waiting
+				const Click click{
+					ray_origin, ray_normal, bg_camera->project_ray_origin(cursor_pos),
+					bg_camera->project_ray_normal(cursor_pos)};
+				click_pending = !select_click(click);
+				pending_click = click;
 			}
 		} else if (mode == Mode::Default || mode == Mode::FPS) {
 			if (mb->get_button_index() == MouseButton::RIGHT) {
@@ -165,6 +200,12 @@ void Viewer::gui_input(const Ref<InputEvent>& p_event) {
 					current_gizmo->mouse_over(true);
 			}
 
+			// Start loading the shapes under the cursor so they're usually in by the time it clicks
+			for (WRL::EntryID entry :
+				 picker.get_unloaded(ray_origin, ray_normal, camera->get_far(), LayerProps | LayerTerrain)) {
+				load_shape(entry);
+			}
+
 		} else if (mode == Mode::FPS) {
 			Vector3 old_rot = camera->get_rotation();
 			Vector2 rel = mm->get_relative() * look_speed;
@@ -181,7 +222,13 @@ void Viewer::gui_input(const Ref<InputEvent>& p_event) {
 }
 
 void Viewer::_notification(int p_what) {
-	if (p_what == NOTIFICATION_PROCESS) {
+	if (p_what == NOTIFICATION_ENTER_TREE) {
+		// Children haven't entered yet, so ask our viewport rather than root
+		set_scenario(get_viewport()->find_world_3d()->get_scenario());
+	} else if (p_what == NOTIFICATION_EXIT_TREE) {
+		set_scenario(RID());
+	} else if (p_what == NOTIFICATION_PROCESS) {
+		PROFILE_SCOPE("Viewer::process");
 		if (mode == Mode::FPS) {
 			Vector3 movement;
 
@@ -210,102 +257,362 @@ void Viewer::_notification(int p_what) {
 			update_cameras();
 		}
 
-		for (WRL::EntryID entry : pending) {
-			Instance& i = instances[entry];
-			Ref<Mesh> mesh = assets.try_get<Mesh>(i.model_path);
-			if (mesh.is_valid()) {
-				i.mesh_instance->set_mesh(mesh);
-			}
-			Ref<Shape3D> shape = assets.try_get<Shape3D>(i.model_path);
-			if (shape.is_valid()) {
-				i.collider = memnew(StaticBody3D);
-				i.mesh_instance->add_child(i.collider);
-				i.collider->set_collision_layer(i.mesh_instance->get_layer_mask());
-				CollisionShape3D* cshape = memnew(CollisionShape3D);
-				i.collider->add_child(cshape, true);
-				cshape->set_shape(shape);
-			}
-			if (mesh.is_valid() && shape.is_valid()) {
-				pending.erase(entry);
-			}
+		{
+			PROFILE_SCOPE("AssetManager::flush_completed");
+			assets.flush_completed();
 		}
+		if (click_pending)
+			click_pending = !select_click(pending_click);
+		{
+			PROFILE_SCOPE("Viewer::update_batches");
+			update_batches();
+		}
+
+		if (stats_label->is_visible())
+			update_stats();
 	}
 }
 
-void Viewer::_wrl_changed(const WRL::Change& change, bool) {
-	for (const auto& r : change.removed) {
-		if (instances.has(r.value)) {
-			instances[r.value].mesh_instance->queue_free();
-			instances.erase(r.value);
-		}
-		if (pending.has(r.value)) {
-			pending.erase(r.value);
+void Viewer::update_stats() {
+	AssetManager::Stats asset_stats = assets.get_stats();
+	Profiler& profiler = Profiler::get_singleton();
+	profiler.add_counter("Assets queued", asset_stats.queued);
+	profiler.add_counter("Assets working", asset_stats.working);
+	profiler.add_counter("Models pending", pending.size());
+
+	const double frame_ms = get_process_delta_time() * 1000;
+	stats_label->set_text(vformat(
+		"Frame: %.2f ms\nAssets: %d queued, %d working, %d loaded, %d failed\nModels pending: %d\n"
+		"Instances: %d, batches: %d\nShift+F3 writes the trace to %s",
+		frame_ms, asset_stats.queued, asset_stats.working, asset_stats.complete, asset_stats.failed, pending.size(),
+		instances.size(), batches.size(), trace_path));
+}
+
+void Viewer::load_model(WRL::EntryID entry) {
+	const String& path = instances[entry].model_path;
+	if (!pending.has(path)) {
+		pending.insert(path, Vector<WRL::EntryID>());
+		assets.on_complete<Mesh>(path, [this, path](Ref<Mesh> mesh) { mesh_loaded(path, mesh); });
+	}
+	pending[path].push_back(entry);
+}
+
+void Viewer::mesh_loaded(const String& path, Ref<Mesh> mesh) {
+	if (mesh.is_valid()) {
+		for (WRL::EntryID entry : pending[path]) {
+			// Skip entries that were removed or given another model while this one loaded
+			if (instances.has(entry) && instances[entry].model_path == path)
+				set_mesh(entry, mesh);
 		}
 	}
+	pending.erase(path);
+}
 
-	for (const auto& a : change.added) {
-		auto& model = wrl->get_entry_format(a.value).model;
-		if (model) {
-			auto mesh_instance = memnew(MeshInstance3D);
-			static std::unordered_map<WRL::Format::Model::Type, Layer> layer_lookup = {
-				{WRL::Format::Model::Type::Prop, LayerProps},
-				{WRL::Format::Model::Type::Terrain, LayerTerrain},
-				{WRL::Format::Model::Type::Skybox, LayerSkyBox},
-			};
-			mesh_instance->set_layer_mask(layer_lookup.at(model.type));
-			root->add_child(mesh_instance);
-			instances.insert(a.value, {.mesh_instance = mesh_instance});
+void Viewer::set_mesh(WRL::EntryID entry, const Ref<Mesh>& mesh) {
+	Instance& i = instances[entry];
+	i.mesh = mesh;
+	if (i.rid.is_valid()) {
+		RS::get_singleton()->instance_set_base(i.rid, mesh->get_rid());
+	} else if (i.batch_index != -1) {
+		Batch& batch = batches[i.model_path];
+		if (batch.multimesh->get_mesh() != mesh)
+			batch.multimesh->set_mesh(mesh);
+	}
+	picker.set_model(entry, mesh->get_aabb());
+}
+
+void Viewer::batch_add(WRL::EntryID entry) {
+	Instance& i = instances[entry];
+	if (!batches.has(i.model_path)) {
+		Batch batch;
+		batch.multimesh.instantiate();
+		batch.multimesh->set_transform_format(MultiMesh::TRANSFORM_3D);
+		batch.rid = RS::get_singleton()->instance_create2(batch.multimesh->get_rid(), scenario);
+		RS::get_singleton()->instance_set_layer_mask(batch.rid, i.layer);
+		RS::get_singleton()->instance_set_transform(batch.rid, root->get_transform());
+
+		// Still loading otherwise, set_mesh will catch up
+		Ref<Mesh> mesh = assets.try_get<Mesh>(i.model_path);
+		if (mesh.is_valid())
+			batch.multimesh->set_mesh(mesh);
+
+		batches.insert(i.model_path, batch);
+	}
+
+	Batch& batch = batches[i.model_path];
+	i.batch_index = batch.entries.size();
+	batch.entries.push_back(entry);
+	if (batch.entries.size() > batch.capacity) {
+		batch.dirty = true;
+	} else if (!batch.dirty) {
+		batch.multimesh->set_instance_transform(i.batch_index, i.get_transform());
+		batch.multimesh->set_visible_instance_count(batch.entries.size());
+	}
+}
+
+void Viewer::batch_remove(WRL::EntryID entry) {
+	Instance& i = instances[entry];
+	Batch& batch = batches[i.model_path];
+
+	// Move the last instance into the gap
+	WRL::EntryID last = batch.entries[batch.entries.size() - 1];
+	batch.entries.set(i.batch_index, last);
+	instances[last].batch_index = i.batch_index;
+	batch.entries.resize(batch.entries.size() - 1);
+	if (!batch.dirty && !batch.entries.is_empty()) {
+		if (last != entry)
+			batch.multimesh->set_instance_transform(i.batch_index, instances[last].get_transform());
+		batch.multimesh->set_visible_instance_count(batch.entries.size());
+	}
+	i.batch_index = -1;
+
+	if (batch.entries.is_empty()) {
+		RS::get_singleton()->free(batch.rid);
+		batches.erase(i.model_path);
+	}
+}
+
+void Viewer::update_batches() {
+	for (auto& b : batches) {
+		Batch& batch = b.value;
+		if (!batch.dirty)
+			continue;
+		batch.dirty = false;
+
+		// Doubling keeps reallocations rare while a world is being built up one instance at a time
+		batch.capacity = MAX(batch.entries.size(), batch.capacity * 2);
+
+		// Rows of the basis with the origin as the fourth column, as MultiMesh expects. The spare rows repeat the
+		// last instance, as rows past the visible count still count towards the MultiMesh's bounds.
+		Vector<float> buffer;
+		buffer.resize(batch.capacity * 12);
+		float* w = buffer.ptrw();
+		for (int e = 0; e < batch.capacity; e++) {
+			Transform3D t = instances[batch.entries[MIN(e, batch.entries.size() - 1)]].get_transform();
+			for (int row = 0; row < 3; row++) {
+				w[e * 12 + row * 4 + 0] = t.basis.rows[row].x;
+				w[e * 12 + row * 4 + 1] = t.basis.rows[row].y;
+				w[e * 12 + row * 4 + 2] = t.basis.rows[row].z;
+				w[e * 12 + row * 4 + 3] = t.origin[row];
+			}
 		}
+		batch.multimesh->set_instance_count(batch.capacity);
+		batch.multimesh->set_buffer(buffer);
+		batch.multimesh->set_visible_instance_count(batch.entries.size());
+	}
+}
+
+void Viewer::set_scenario(RID p_scenario) {
+	scenario = p_scenario;
+	for (const auto& i : instances) {
+		if (i.value.rid.is_valid())
+			RS::get_singleton()->instance_set_scenario(i.value.rid, scenario);
+	}
+	for (const auto& b : batches) {
+		RS::get_singleton()->instance_set_scenario(b.value.rid, scenario);
+	}
+}
+
+void Viewer::instance_add(WRL::EntryID entry) {
+	Instance& i = instances[entry];
+	if (i.mesh.is_null() && !i.model_path.is_empty())
+		i.mesh = assets.try_get<Mesh>(i.model_path);
+
+	// Still loading if there's no mesh, set_mesh will give it one
+	i.rid = RS::get_singleton()->instance_create2(i.mesh.is_valid() ? i.mesh->get_rid() : RID(), scenario);
+	RS::get_singleton()->instance_set_layer_mask(i.rid, i.layer);
+	RS::get_singleton()->instance_set_transform(i.rid, root->get_transform() * i.get_transform());
+}
+
+void Viewer::instance_remove(WRL::EntryID entry) {
+	Instance& i = instances[entry];
+	RS::get_singleton()->free(i.rid);
+	i.rid = RID();
+}
+
+Layer Viewer::get_layer(WRL::Format::Model::Type type) {
+	switch (type) {
+		case WRL::Format::Model::Type::Prop:
+			return LayerProps;
+		case WRL::Format::Model::Type::Terrain:
+			return LayerTerrain;
+		case WRL::Format::Model::Type::Skybox:
+			return LayerSkyBox;
+	}
+	return LayerProps;
+}
+
+void Viewer::remove_all() {
+	for (const auto& i : instances) {
+		if (i.value.rid.is_valid())
+			RS::get_singleton()->free(i.value.rid);
+	}
+	for (const auto& b : batches) {
+		RS::get_singleton()->free(b.value.rid);
 	}
+	instances.clear();
+	batches.clear();
+	picker.clear();
+	click_pending = false;
+	selected = WRL::EntryID();
+}
 
-	for (const auto& prop : change.propertyChanges) {
-		WRL::EntryID entry = prop.key.first;
-		if (!instances.has(entry))
+void Viewer::add_all(const WRL::EntrySet& added) {
+	instances.reserve(instances.size() + added.size());
+
+	// Read straight from the WRL's columns rather than through the change's property map. Entries arrive in file
+	// order, so the columns are only looked up again when the type changes.
+	int table_index = -1;
+	const Vector3* positions = nullptr;
+	const Quaternion* rotations = nullptr;
+	const Vector3* scales = nullptr;
+	const WRL::Column* models = nullptr;
+	for (const auto& a : added) {
+		WRL::EntryID entry = a.value;
+		WRL::Location location = wrl->get_location(entry);
+		const WRL::Table& table = wrl->get_table(location.table);
+		auto& model = table.format->model;
+		if (!model)
 			continue;
 
-		auto& model = wrl->get_entry_format(entry).model;
-		String prop_name = prop.key.second;
-		if (prop_name == model.model) {
-			const String& model = prop.value;
-			if (instances[entry].model_path != model) {
-				if (instances[entry].collider)
-					instances[entry].collider->queue_free();
-				instances[entry].model_path = model;
-				pending.insert(entry);
-			}
+		if (location.table != table_index) {
+			table_index = location.table;
+			positions = model.position_id ? table.columns[model.position_id.index].vector3s.ptr() : nullptr;
+			rotations = model.rotation_id ? table.columns[model.rotation_id.index].quaternions.ptr() : nullptr;
+			scales = model.scale_id ? table.columns[model.scale_id.index].vector3s.ptr() : nullptr;
+			models = model.model_id ? &table.columns[model.model_id.index] : nullptr;
 		}
 
-		else if (prop_name == model.position || prop_name == model.rotation || prop_name == model.scale) {
-			if (prop_name == model.position) {
-				instances[entry].position = prop.value;
-			} else if (prop_name == model.rotation) {
-				instances[entry].rotation = prop.value;
-			} else if (prop_name == model.scale) {
-				instances[entry].scale = prop.value;
+		Instance i{
+			.layer = get_layer(model.type),
+			.batchable = model.type == WRL::Format::Model::Type::Prop && model.uniforms.is_empty()};
+		if (positions)
+			i.position = positions[location.row];
+		if (rotations)
+			i.rotation = rotations[location.row];
+		if (scales)
+			i.scale = scales[location.row];
+		if (models)
+			i.model_path = models->get_string(location.row);
+		instances.insert(entry, i);
+
+		// Batches only get their transforms uploaded once, by update_batches
+		if (!i.batchable) {
+			instance_add(entry);
+			for (int u = 0; u < model.uniforms.size(); u++) {
+				RS::get_singleton()->instance_geometry_set_shader_parameter(
+					instances[entry].rid, model.uniforms[u], wrl->get_entry_property(entry, model.uniform_ids[u]));
 			}
+		} else if (!i.model_path.is_empty()) {
+			batch_add(entry);
+		}
 
-			instances[entry].mesh_instance->set_transform(Transform3D(
-				Basis(instances[entry].rotation).scaled(instances[entry].scale), instances[entry].position));
+		picker.set_layers(entry, i.layer);
+		picker.set_transform(entry, root->get_transform() * i.get_transform());
+		if (!i.model_path.is_empty())
+			load_model(entry);
+	}
+}
+
+void Viewer::_wrl_changed(const WRL::Change& change, bool reset) {
+	PROFILE_SCOPE("Viewer::_wrl_changed");
+	if (reset) {
+		// A whole world was opened or closed, build it in one pass instead of property by property
+		remove_all();
+		add_all(change.added);
+	} else {
+		for (const auto& r : change.removed) {
+			if (instances.has(r.value)) {
+				Instance& i = instances[r.value];
+				if (i.rid.is_valid())
+					instance_remove(r.value);
+				if (i.batch_index != -1)
+					batch_remove(r.value);
+				instances.erase(r.value);
+				picker.remove(r.value);
+			}
+			if (selected == r.value) {
+				selected = WRL::EntryID();
+				update_gizmos(selected);
+			}
 		}
 
-		else if (model.uniforms.has(prop_name)) {
-			instances[entry].mesh_instance->set_instance_shader_parameter(prop_name, prop.value);
+		add_all(change.added);
+
+		for (const auto& prop : change.propertyChanges) {
+			WRL::EntryID entry = prop.key.first;
+			if (!instances.has(entry))
+				continue;
+
+			Instance& i = instances[entry];
+			auto& model = wrl->get_entry_format(entry).model;
+			WRL::PropertyID prop_id = prop.key.second;
+			int uniform = model.uniform_ids.find(prop_id);
+			if (prop_id == model.model_id) {
+				const String& model = prop.value;
+				if (i.model_path != model) {
+					if (i.batch_index != -1)
+						batch_remove(entry);
+					i.model_path = model;
+					i.mesh.unref();
+					// Keep the old model from showing until the new one loads
+					if (i.rid.is_valid())
+						RS::get_singleton()->instance_set_base(i.rid, RID());
+					if (i.batchable && entry != selected && !model.is_empty())
+						batch_add(entry);
+					picker.set_model(entry, AABB());
+					if (!model.is_empty())
+						load_model(entry);
+				}
+			}
+
+			else if (prop_id == model.position_id || prop_id == model.rotation_id || prop_id == model.scale_id) {
+				if (prop_id == model.position_id) {
+					i.position = prop.value;
+				} else if (prop_id == model.rotation_id) {
+					i.rotation = prop.value;
+				} else if (prop_id == model.scale_id) {
+					i.scale = prop.value;
+				}
+
+				Transform3D transform = i.get_transform();
+				if (i.rid.is_valid()) {
+					RS::get_singleton()->instance_set_transform(i.rid, root->get_transform() * transform);
+				} else if (i.batch_index != -1) {
+					Batch& batch = batches[i.model_path];
+					if (!batch.dirty)
+						batch.multimesh->set_instance_transform(i.batch_index, transform);
+				}
+				picker.set_transform(entry, root->get_transform() * transform);
+			}
+
+			else if (uniform != -1) {
+				RS::get_singleton()->instance_geometry_set_shader_parameter(
+					i.rid, model.uniforms[uniform], prop.value);
+			}
 		}
 	}
 
 	if (change.select_changed) {
+		// The selected instance leaves its batch so edits to it don't touch the MultiMesh
+		if (selected && instances.has(selected) && instances[selected].batchable) {
+			instance_remove(selected);
+			if (!instances[selected].model_path.is_empty())
+				batch_add(selected);
+		}
+		selected = change.select.second;
+		if (selected && instances.has(selected) && instances[selected].batchable) {
+			if (instances[selected].batch_index != -1)
+				batch_remove(selected);
+			instance_add(selected);
+		}
+
 		update_gizmos(change.select.second);
 	}
 }
 
-Viewer::Viewer(const CustomFS& p_custom_fs) : custom_fs(p_custom_fs), assets(custom_fs) {
-	assets.add_loader<ImageAssetLoader>();
-	assets.add_loader<ImageTextureLoader>();
-	assets.add_loader<IFLLoader>();
-	assets.add_loader<MDL2Loader>();
-	assets.add_loader<TDFLoader>();
-	assets.add_loader<TDFMeshLoader>();
-	assets.add_loader<MeshShapeLoader>();
+Viewer::Viewer(AssetManager& p_assets) : assets(p_assets) {
+	Profiler::get_singleton().set_thread_name("Main");
 
 	set_process(true);
 	set_process_input(true);
@@ -327,6 +634,12 @@ Viewer::Viewer(const CustomFS& p_custom_fs) : custom_fs(p_custom_fs), assets(cus
 
 	SubViewport* viewport = memnew(SubViewport);
 	viewport_container->add_child(viewport);
+
+	stats_label = memnew(Label);
+	stats_label->set_position(Vector2(8, 8));
+	stats_label->set_mouse_filter(Control::MOUSE_FILTER_IGNORE);
+	stats_label->set_visible(false);
+	viewport_container->add_child(stats_label);
 	camera = memnew(Camera3D);
 	camera->set_near(1);
 	camera->set_cull_mask(LayerProps | LayerTerrain | LayerGizmo);
@@ -356,4 +669,6 @@ void fragment() { ALBEDO = texture(skybox, UV).rgb; }
 	DirectionalLight3D* l = memnew(DirectionalLight3D);
 	l->rotate_x(-Math_PI / 4);
 	add_child(l);
-}
\ No newline at end of file
+}
+
+Viewer::~Viewer() { remove_all(); }
\ No newline at end of file
@@ -1,14 +1,16 @@
 #pragma once
 
-#include "scene/3d/mesh_instance_3d.h"
-#include "scene/3d/physics_body_3d.h"
+#include "scene/3d/node_3d.h"
+#include "scene/resources/mesh.h"
+#include "scene/resources/multimesh.h"
 #include "scene/gui/box_container.h"
+#include "scene/gui/label.h"
 #include "scene/main/viewport.h"
 
 #include "gizmo.hpp"
 #include "layer.hpp"
+#include "picker.hpp"
 #include "lr2/assets/asset_manager.hpp"
-#include "lr2/io/custom_fs.hpp"
 #include "lr2/wrl/wrl.hpp"
 
 class Viewer : public BoxContainer, public WRL::EventHandler {
@@ -27,35 +29,92 @@ class Viewer : public BoxContainer, public WRL::EventHandler {
 		Vector3 position;
 		Quaternion rotation;
 		Vector3 scale = {1, 1, 1};
+		Transform3D get_transform() const { return Transform3D(Basis(rotation).scaled(scale), position); }
 
-		MeshInstance3D* mesh_instance;
-		String model_path;
+		Layer layer;
+		bool batchable; // Props without instance uniforms can share a MultiMesh with the rest of their model
 
-		CollisionObject3D* collider = nullptr;
+		RID rid; // RenderingServer instance, only valid when not in a batch
+		Ref<Mesh> mesh;
+		String model_path;
+		int batch_index = -1;
 	};
-	struct Hasher {
-		static _FORCE_INLINE_ uint32_t hash(const WRL::EntryID& key) { return HashMapHasherDefault::hash(key.id); }
+	HashMap<WRL::EntryID, Instance, WRL::EntryID::Hasher> instances;
+
+	// Entries waiting on each model, filled in by mesh_loaded when the AssetManager reports it done
+	HashMap<String, Vector<WRL::EntryID>> pending;
+	void load_model(WRL::EntryID);
+	void mesh_loaded(const String& path, Ref<Mesh>);
+	void set_mesh(WRL::EntryID, const Ref<Mesh>&);
+
+	// Every instance of a model drawn with one MultiMesh, except the selected one which gets its own instance.
+	// The MultiMesh is allocated with room to spare and only draws the first entries.size() rows, so adding and
+	// removing instances rewrites single rows instead of the whole buffer.
+	struct Batch {
+		RID rid;
+		Ref<MultiMesh> multimesh;
+		Vector<WRL::EntryID> entries;
+		int capacity = 0; // Rows allocated in the MultiMesh
+		bool dirty = true; // Every row needs writing, once entries outgrows capacity
 	};
-	HashMap<WRL::EntryID, Instance, Hasher> instances;
+	HashMap<String, Batch> batches;
+	void batch_add(WRL::EntryID);
+	void batch_remove(WRL::EntryID);
+	void update_batches();
+
+	// World instances skip the scene tree and go straight to the RenderingServer, placed under root's transform
+	RID scenario;
+	void set_scenario(RID);
+	void instance_add(WRL::EntryID);
+	void instance_remove(WRL::EntryID);
 
-	HashSet<WRL::EntryID, Hasher> pending;
+	WRL::EntryID selected;
+
+	static Layer get_layer(WRL::Format::Model::Type);
+	void remove_all();
+	void add_all(const WRL::EntrySet& added);
+
+	Picker picker;
+	// Entries waiting on the shape of each model, requested once a ray first reaches their bounds
+	HashMap<String, Vector<WRL::EntryID>> pending_shapes;
+	void load_shape(WRL::EntryID);
+	void shape_loaded(const String& path, Ref<PickShape>);
+	bool pick(
+		const Vector3& ray_origin, const Vector3& ray_normal, real_t max_distance, uint32_t layers,
+		WRL::EntryID& r_entry);
+
+	// A click that reached shapes still loading is kept and tried again every frame until it can be answered
+	struct Click {
+		Vector3 origin;
+		Vector3 normal;
+		Vector3 bg_origin;
+		Vector3 bg_normal;
+	};
+	Click pending_click;
+	bool click_pending = false;
+	bool select_click(const Click&);
 
 	Vector<Gizmo*> gizmos;
 	Gizmo* current_gizmo = nullptr;
 	void update_gizmos(WRL::EntryID);
 	void update_cameras();
 
+	// F3 toggles the overlay and profiler recording
+	Label* stats_label;
+	const String trace_path = "user://lr2_trace.json";
+	void update_stats();
+
   protected:
 	void input(const Ref<InputEvent>& p_event) override;
 	void gui_input(const Ref<InputEvent>& p_event) override;
 	void _notification(int p_what);
 
   private:
-	const CustomFS& custom_fs;
-	AssetManager assets;
+	AssetManager& assets; // Shared with the rest of the editor
 
   public:
-	Viewer(const CustomFS&);
+	Viewer(AssetManager&);
+	~Viewer();
 
   protected:
 	void _wrl_changed(const WRL::Change&, bool) override;
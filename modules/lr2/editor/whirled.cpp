@@ -1,13 +1,31 @@
 #include "whirled.hpp"
 
+#include "core/config/project_settings.h"
+#include "core/input/shortcut.h"
 #include "scene/gui/panel_container.h"
 #include "scene/gui/split_container.h"
 
 #include "inspector.hpp"
+#include "lr2/assets/loaders.hpp"
+
+static Ref<Shortcut> _shortcut(Key key, bool shift) {
+	Ref<InputEventKey> event;
+	event.instantiate();
+	event->set_keycode(key);
+	event->set_command_or_control_autoremap(true);
+	event->set_shift_pressed(shift);
+	Array events;
+	events.push_back(event);
+	Ref<Shortcut> shortcut;
+	shortcut.instantiate();
+	shortcut->set_events(events);
+	return shortcut;
+}
 
 void Whirled::_menu_new() {
 	file_path = "";
 	wrl->clear();
+	journal.reset(file_path);
 }
 void Whirled::_menu_open() {
 	_file_reset();
@@ -28,16 +46,31 @@ void Whirled::_menu_save_as() {
 	file->connect("file_selected", callable_mp(this, &Whirled::_file_save_as));
 	file->popup_centered_clamped(Size2(600, 400));
 }
+void Whirled::_menu_undo() { wrl->undo(); }
+void Whirled::_menu_redo() { wrl->redo(); }
+
+void Whirled::UndoButtons::_wrl_changed(const WRL::Change&, bool) {
+	const String undo_name = wrl->get_undo_name();
+	undo->set_text(undo_name.is_empty() ? String("Undo") : "Undo " + undo_name);
+	undo->set_disabled(!wrl->can_undo());
+	const String redo_name = wrl->get_redo_name();
+	redo->set_text(redo_name.is_empty() ? String("Redo") : "Redo " + redo_name);
+	redo->set_disabled(!wrl->can_redo());
+}
 
 void Whirled::_file_open(String path) {
-	file_path = path;
 	Ref<FileAccess> file = custom_fs.FileAccess_open(path, FileAccess::ModeFlags::READ);
-	wrl->load(file);
+	const Error err = wrl->load(file, &assets);
+	// A failed load leaves an empty world, which isn't the file
+	file_path = err == OK ? path : "";
+	journal.reset(file_path);
+	ERR_FAIL_COND_MSG(err != OK, "Couldn't load " + path);
 }
 void Whirled::_file_save_as(String path) {
 	file_path = path;
-	Ref<FileAccess> file = custom_fs.FileAccess_open(path, FileAccess::ModeFlags::WRITE);
-	wrl->save(file);
+	Error err = custom_fs.store_file_atomic(path, wrl->save_to_buffer());
+	ERR_FAIL_COND_MSG(err != OK, "Couldn't save " + path);
+	journal.reset(file_path);
 }
 void Whirled::_file_reset() {
 	if (file->is_connected("file_selected", callable_mp(this, &Whirled::_file_open))) {
@@ -48,8 +81,40 @@ void Whirled::_file_reset() {
 	}
 }
 
-Whirled::Whirled(const CustomFS p_custom_fs) : custom_fs(p_custom_fs) {
+void Whirled::_notification(int p_what) {
+	if (p_what == NOTIFICATION_READY) {
+		set_process(true);
+		if (recovery_dialog)
+			recovery_dialog->popup_centered();
+	} else if (p_what == NOTIFICATION_PROCESS) {
+		journal.poll();
+	}
+}
+
+Whirled::Whirled(const CustomFS p_custom_fs) : custom_fs(p_custom_fs), assets(custom_fs) {
+	add_lr2_loaders(assets);
 	wrl.instantiate();
+	journal.wrl_connect(wrl);
+	String recovery_message;
+	Error err = journal.recover(custom_fs, file_path, &assets);
+	if (err == OK) {
+		recovery_message = "Restored the last session from its autosave, " +
+			(file_path.is_empty() ? String("the world hasn't been saved yet") : "the world is " + file_path) + ".";
+	} else if (err != ERR_FILE_NOT_FOUND) {
+		// Kept rather than overwritten, it's the only copy of those changes
+		wrl->clear();
+		const String kept_path = journal.set_aside();
+		if (kept_path.is_empty()) {
+			recovery_message = "Couldn't recover the unsaved changes from the last session, autosave is off so they "
+							   "aren't overwritten.";
+		} else {
+			recovery_message = "Couldn't recover the unsaved changes from the last session. They were kept in " +
+				ProjectSettings::get_singleton()->globalize_path(kept_path) + ".";
+			journal.reset(file_path);
+		}
+	} else {
+		journal.reset(file_path);
+	}
 
 	// TODO: Theme
 
@@ -63,6 +128,13 @@ Whirled::Whirled(const CustomFS p_custom_fs) : custom_fs(p_custom_fs) {
 	file->add_filter("*.WRL; LR2 Worlds");
 	base->add_child(file);
 
+	if (!recovery_message.is_empty()) {
+		recovery_dialog = memnew(AcceptDialog);
+		recovery_dialog->set_title("Autosave");
+		recovery_dialog->set_text(recovery_message);
+		base->add_child(recovery_dialog);
+	}
+
 	VBoxContainer* main_vbox = memnew(VBoxContainer);
 	base->add_child(main_vbox);
 
@@ -89,6 +161,17 @@ Whirled::Whirled(const CustomFS p_custom_fs) : custom_fs(p_custom_fs) {
 	save_as_button->set_text("Save As");
 	save_as_button->connect("pressed", callable_mp(this, &Whirled::_menu_save_as));
 
+	undo_buttons.undo = memnew(Button);
+	menu->add_child(undo_buttons.undo);
+	undo_buttons.undo->set_shortcut(_shortcut(Key::Z, false));
+	undo_buttons.undo->connect("pressed", callable_mp(this, &Whirled::_menu_undo));
+
+	undo_buttons.redo = memnew(Button);
+	menu->add_child(undo_buttons.redo);
+	undo_buttons.redo->set_shortcut(_shortcut(Key::Z, true));
+	undo_buttons.redo->connect("pressed", callable_mp(this, &Whirled::_menu_redo));
+	undo_buttons.wrl_connect(wrl);
+
 	HSplitContainer* right_drawer_split = memnew(HSplitContainer);
 	main_vbox->add_child(right_drawer_split);
 	right_drawer_split->set_v_size_flags(Control::SIZE_EXPAND_FILL);
@@ -101,7 +184,7 @@ Whirled::Whirled(const CustomFS p_custom_fs) : custom_fs(p_custom_fs) {
 	HSplitContainer* left_drawer_split = memnew(HSplitContainer);
 	right_drawer_split->add_child(left_drawer_split);
 
-	viewer = memnew(Viewer(custom_fs));
+	viewer = memnew(Viewer(assets));
 	left_drawer_split->add_child(viewer);
 	viewer->set_h_size_flags(Control::SIZE_EXPAND_FILL);
 	viewer->wrl_connect(wrl);
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "scene/gui/button.h"
+
+#include "lr2/assets/asset_manager.hpp"
 #include "lr2/io/custom_file_dialog.hpp"
 #include "lr2/io/custom_fs.hpp"
+#include "lr2/wrl/journal.hpp"
 #include "lr2/wrl/wrl.hpp"
 #include "scene_layout.hpp"
 #include "viewer/viewer.hpp"
@@ -11,10 +15,24 @@ class Whirled : public Node {
 
   private:
 	const CustomFS custom_fs;
+	AssetManager assets;
 	String file_path = "";
 	Ref<WRL> wrl;
+	Journal journal;
+
+	// Keeps the Undo and Redo buttons named after the action they'd apply, and disabled when there's none
+	class UndoButtons : public WRL::EventHandler {
+	  public:
+		Button* undo = nullptr;
+		Button* redo = nullptr;
+
+	  protected:
+		void _wrl_changed(const WRL::Change&, bool reset) override;
+		bool lite_init() override { return true; }
+	} undo_buttons;
 
 	CustomFileDialog* file;
+	AcceptDialog* recovery_dialog = nullptr; // Shown once ready, if there was anything to recover
 
 	Viewer* viewer;
 	SceneLayout* scene;
@@ -23,11 +41,16 @@ class Whirled : public Node {
 	void _menu_open();
 	void _menu_save();
 	void _menu_save_as();
+	void _menu_undo();
+	void _menu_redo();
 
 	void _file_open(String path);
 	void _file_save_as(String path);
 	void _file_reset();
 
+  protected:
+	void _notification(int p_what);
+
   public:
 	Whirled(const CustomFS);
 };
\ No newline at end of file
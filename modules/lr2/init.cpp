@@ -4,6 +4,10 @@
 #include "servers/navigation_server_3d.h"
 #include "servers/physics_server_2d.h"
 
+#include "debug/benchmark.hpp"
+#include "debug/generator.hpp"
+#include "debug/microbenchmark.hpp"
+#include "debug/self_test.hpp"
 #include "editor/whirled.hpp"
 
 void Init::_notification(int p_notification) {
@@ -12,6 +16,26 @@ void Init::_notification(int p_notification) {
 		// get_tree()->set_debug_collisions_hint(true);
 		// TODO: Locate lr2
 
+		List<String> args = OS::get_singleton()->get_cmdline_user_args();
+		if (args.find("--generate")) {
+			// Writes its own data tree, so doesn't need the game
+			get_tree()->quit(run_generator(args));
+			return;
+		}
+		if (args.find("--microbenchmark")) {
+			get_tree()->quit(run_microbenchmark(args));
+			return;
+		}
+		if (args.find("--self-test")) {
+			get_tree()->quit(run_self_test(args));
+			return;
+		}
+		if (args.find("--benchmark")) {
+			// Reads the data directory it's given rather than the game's
+			get_tree()->quit(run_benchmark(args));
+			return;
+		}
+
 		String lr2_dir = OS::get_singleton()->get_environment("LR2_PATH");
 		bool found = DirAccess::exists(lr2_dir);
 
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstring>
+#include <string_view>
+
+#include "core/io/marshalls.h"
+#include "core/math/color.h"
+#include "core/math/quaternion.h"
+#include "core/math/vector2.h"
+#include "core/math/vector3.h"
+#include "core/string/ustring.h"
+#include "core/templates/vector.h"
+
+// Little endian reads from a buffer already in memory, the same primitives as file_helper.hpp without a virtual
+// call per byte. Reading past the end returns zeros and sets overrun, like FileAccess does with eof_reached.
+// The cursor doesn't own the buffer.
+class ByteCursor {
+  private:
+	const uint8_t* data = nullptr;
+	uint64_t size = 0;
+	uint64_t position = 0;
+	bool overrun = false;
+
+	// Null if fewer than length bytes remain, the position still moves so later offsets stay consistent
+	_FORCE_INLINE_ const uint8_t* _take(uint64_t length) {
+		// Written so a huge length from a damaged file can't wrap around
+		const uint8_t* ret = position <= size && length <= size - position ? data + position : nullptr;
+		position += length;
+		if (!ret)
+			overrun = true;
+		return ret;
+	}
+
+  public:
+	ByteCursor() = default;
+	ByteCursor(const uint8_t* p_data, uint64_t p_size) : data(p_data), size(p_size) {}
+	// The vector must outlive the cursor
+	ByteCursor(const Vector<uint8_t>& p_data) : data(p_data.ptr()), size(p_data.size()) {}
+
+	uint64_t get_position() const { return position; }
+	uint64_t get_length() const { return size; }
+	uint64_t get_remaining() const { return position < size ? size - position : 0; }
+	void seek(uint64_t p_position) { position = p_position; }
+	void skip(uint64_t length) { position += length; }
+	bool has_overrun() const { return overrun; }
+	const uint8_t* ptr() const { return data; }
+
+	// Cursor over length bytes from offset, cut short and marked as overrun if they aren't all there
+	ByteCursor sub_cursor(uint64_t offset, uint64_t length) const {
+		ByteCursor ret;
+		if (offset < size) {
+			ret.data = data + offset;
+			ret.size = MIN(length, size - offset);
+		}
+		ret.overrun = ret.size < length;
+		return ret;
+	}
+	// Cursor over the next length bytes, for a chunk that is parsed on its own
+	ByteCursor get_chunk(uint64_t length) {
+		ByteCursor ret = sub_cursor(position, length);
+		position += length;
+		if (ret.overrun)
+			overrun = true;
+		return ret;
+	}
+
+	_FORCE_INLINE_ uint8_t get_8() {
+		const uint8_t* p = _take(1);
+		return p ? *p : 0;
+	}
+	_FORCE_INLINE_ uint16_t get_16() {
+		const uint8_t* p = _take(2);
+		return p ? decode_uint16(p) : 0;
+	}
+	_FORCE_INLINE_ uint32_t get_32() {
+		const uint8_t* p = _take(4);
+		return p ? decode_uint32(p) : 0;
+	}
+	_FORCE_INLINE_ uint64_t get_64() {
+		const uint8_t* p = _take(8);
+		return p ? decode_uint64(p) : 0;
+	}
+	_FORCE_INLINE_ float get_float() {
+		const uint8_t* p = _take(4);
+		return p ? decode_float(p) : 0;
+	}
+	uint64_t get_buffer(uint8_t* p_dst, uint64_t length) {
+		uint64_t available = position < size ? MIN(length, size - position) : 0;
+		if (available > 0) // data can be null when there's nothing to read
+			memcpy(p_dst, data + position, available);
+		position += length;
+		if (available < length)
+			overrun = true;
+		return available;
+	}
+
+	_FORCE_INLINE_ Vector2 get_vector2() {
+		float x = get_float();
+		float y = get_float();
+		return Vector2(x, y);
+	}
+	_FORCE_INLINE_ Vector3 get_vector3() {
+		float x = get_float();
+		float y = get_float();
+		float z = get_float();
+		return Vector3(x, y, z);
+	}
+	_FORCE_INLINE_ Quaternion get_quaternion() {
+		float x = get_float();
+		float y = get_float();
+		float z = get_float();
+		float w = get_float();
+		return Quaternion(x, y, z, w);
+	}
+	_FORCE_INLINE_ Color get_colour() {
+		float r = get_float();
+		float g = get_float();
+		float b = get_float();
+		float a = get_float();
+		return Color(r, g, b, a);
+	}
+	// Fixed size field that ends at the first null, pointing into the buffer
+	std::string_view get_string_view(int length) {
+		const char* p = (const char*)_take(length);
+		if (!p)
+			return std::string_view();
+		const void* end = memchr(p, 0, length);
+		return std::string_view(p, end ? (const char*)end - p : length);
+	}
+	String get_string(int length) {
+		std::string_view view = get_string_view(length);
+		String ret;
+		if (!view.empty())
+			ret.parse_utf8(view.data(), view.size());
+		return ret;
+	}
+};
+
+// Appends little endian values to a growing buffer, for building a file in memory and writing it in one go
+class ByteWriter {
+  private:
+	Vector<uint8_t> data; // Capacity, only the first end bytes are written
+	uint64_t position = 0;
+	uint64_t end = 0;
+
+	_FORCE_INLINE_ uint8_t* _put(uint64_t length) {
+		if (position + length > uint64_t(data.size()))
+			data.resize(MAX(position + length, uint64_t(data.size()) * 2));
+		// A seek past the end leaves a gap, which reads back as zeros
+		if (position > end)
+			memset(data.ptrw() + end, 0, position - end);
+		uint8_t* ret = data.ptrw() + position;
+		position += length;
+		end = MAX(end, position);
+		return ret;
+	}
+
+  public:
+	uint64_t get_position() const { return position; }
+	// Seeking back is for patching values like lengths, the result always ends at the furthest write
+	void seek(uint64_t p_position) { position = p_position; }
+	uint64_t get_length() const { return end; }
+
+	void reserve(uint64_t size) {
+		if (size > uint64_t(data.size()))
+			data.resize(size);
+	}
+	// The written bytes, the writer is empty afterwards
+	Vector<uint8_t> finish() {
+		data.resize(end);
+		Vector<uint8_t> ret = data;
+		data.clear();
+		position = end = 0;
+		return ret;
+	}
+
+	_FORCE_INLINE_ void store_8(uint8_t v) { *_put(1) = v; }
+	_FORCE_INLINE_ void store_16(uint16_t v) { encode_uint16(v, _put(2)); }
+	_FORCE_INLINE_ void store_32(uint32_t v) { encode_uint32(v, _put(4)); }
+	_FORCE_INLINE_ void store_64(uint64_t v) { encode_uint64(v, _put(8)); }
+	_FORCE_INLINE_ void store_float(float v) { encode_float(v, _put(4)); }
+	void store_buffer(const uint8_t* src, uint64_t length) { memcpy(_put(length), src, length); }
+
+	_FORCE_INLINE_ void store_vector2(const Vector2& v) {
+		store_float(v.x);
+		store_float(v.y);
+	}
+	_FORCE_INLINE_ void store_vector3(const Vector3& v) {
+		store_float(v.x);
+		store_float(v.y);
+		store_float(v.z);
+	}
+	_FORCE_INLINE_ void store_quaternion(const Quaternion& q) {
+		store_float(q.x);
+		store_float(q.y);
+		store_float(q.z);
+		store_float(q.w);
+	}
+	// Fixed size field, padded with nulls
+	void store_string(const String& str, int length) {
+		CharString cs = str.ascii();
+		uint8_t* p = _put(length);
+		int copied = MIN(cs.length(), length);
+		memcpy(p, cs.ptr(), copied);
+		memset(p + copied, 0, length - copied);
+	}
+};
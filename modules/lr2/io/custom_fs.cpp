@@ -1,5 +1,9 @@
 #include "custom_fs.hpp"
 
+#include <atomic>
+
+#include "lr2/io/file_helper.hpp"
+
 String FSResolve::resolve_path(const String& p_path) const {
 	Ref<DirAccess> dir_access(DirAccess::create_for_path(root));
 
@@ -110,14 +114,18 @@ class LR2DirAccess : public DirAccess {
 	}
 };
 
+static std::atomic<uint64_t> total_bytes_read = 0;
+
 class LR2FileAccess : public FileAccess {
   private:
 	const FSResolve fs_resolve;
 	Ref<FileAccess> file;
+	mutable uint64_t bytes_read = 0; // Added to total_bytes_read when closed, to keep the atomic off the hot path
 
   public:
 	LR2FileAccess(const FSResolve& p_fs_resolve)
 		: fs_resolve(p_fs_resolve), file(FileAccess::create(FileAccess::ACCESS_FILESYSTEM)) {}
+	~LR2FileAccess() { total_bytes_read += bytes_read; }
 
   public:
 	uint32_t _get_unix_permissions(const String& p_file) override {
@@ -163,18 +171,21 @@ class LR2FileAccess : public FileAccess {
 
 	bool eof_reached() const override { return file->eof_reached(); }
 
-	uint8_t get_8() const override { return file->get_8(); }
-
-	Error get_error() const override {
-		ERR_PRINT("NOT IMPLEMENTED");
-		return file->get_error();
+	uint8_t get_8() const override {
+		bytes_read++;
+		return file->get_8();
 	}
-
-	void flush() override {
-		ERR_PRINT("NOT IMPLEMENTED");
-		file->flush();
+	uint64_t get_buffer(uint8_t* p_dst, uint64_t p_length) const override {
+		uint64_t read = file->get_buffer(p_dst, p_length);
+		bytes_read += read;
+		return read;
 	}
+
+	Error get_error() const override { return file->get_error(); }
+
+	void flush() override { file->flush(); }
 	void store_8(uint8_t p_dest) override { file->store_8(p_dest); }
+	void store_buffer(const uint8_t* p_src, uint64_t p_length) override { file->store_buffer(p_src, p_length); }
 
 	bool file_exists(const String& p_name) override {
 		ERR_PRINT("NOT IMPLEMENTED");
@@ -213,6 +224,8 @@ Ref<DirAccess> CustomFS::DirAccess_open(const String& p_path, Error* r_error) co
 	return da;
 }
 
+uint64_t CustomFS::get_total_bytes_read() { return total_bytes_read; }
+
 String CustomFS::canon_path(const String& p_path) const { return fs_resolve.resolve_path(p_path); }
 
 bool CustomFS::file_exists(const String& p_path) const {
@@ -238,6 +251,10 @@ Vector<uint8_t> CustomFS::get_file_as_array(const String& p_path, Error* r_error
 	f->get_buffer(data.ptrw(), data.size());
 	return data;
 }
+Error CustomFS::store_file_atomic(const String& p_path, const Vector<uint8_t>& p_data) const {
+	return ::store_file_atomic(fs_resolve.map_path(fs_resolve.resolve_path(p_path)), p_data);
+}
+
 String CustomFS::get_file_as_string(const String& p_path, Error* r_error) const {
 	Error err;
 	Vector<uint8_t> array = get_file_as_array(p_path, &err);
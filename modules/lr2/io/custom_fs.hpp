@@ -33,4 +33,8 @@ class CustomFS {
 
 	Vector<uint8_t> get_file_as_array(const String& p_path, Error* r_error = nullptr) const;
 	String get_file_as_string(const String& p_path, Error* r_error = nullptr) const;
+	// Writes to a temporary file then renames it over p_path, so p_path is never left half written
+	Error store_file_atomic(const String& p_path, const Vector<uint8_t>& p_data) const;
+
+	static uint64_t get_total_bytes_read(); // Across every CustomFS, counted as files are closed
 };
\ No newline at end of file
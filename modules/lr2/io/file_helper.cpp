@@ -0,0 +1,75 @@
+#include "file_helper.hpp"
+
+#ifdef WINDOWS_ENABLED
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "core/config/project_settings.h"
+#include "core/os/os.h"
+
+Error store_file_atomic(const String& p_path, const Vector<uint8_t>& data) {
+	const String path = ProjectSettings::get_singleton()->globalize_path(p_path);
+	// Unique and created exclusively, so no existing file is overwritten
+	const String temp_path = path + "." + itos(OS::get_singleton()->get_process_id()) + "." +
+		itos(OS::get_singleton()->get_ticks_usec()) + ".tmp";
+	const uint8_t* src = data.ptr();
+	uint64_t remaining = data.size();
+
+#ifdef WINDOWS_ENABLED
+	const Char16String temp = temp_path.utf16();
+	const Char16String target = path.utf16();
+	HANDLE handle = CreateFileW(
+		(LPCWSTR)temp.get_data(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+	ERR_FAIL_COND_V_MSG(handle == INVALID_HANDLE_VALUE, ERR_FILE_CANT_WRITE, "Can't create file '" + temp_path + "'.");
+	bool ok = true;
+	while (ok && remaining > 0) {
+		const DWORD length = DWORD(MIN(remaining, uint64_t(1) << 30));
+		DWORD written = 0;
+		ok = WriteFile(handle, src, length, &written, nullptr) && written == length;
+		src += written;
+		remaining -= written;
+	}
+	ok = ok && FlushFileBuffers(handle);
+	ok = CloseHandle(handle) && ok;
+	// Unlike DirAccess::rename, which removes the target first
+	ok = ok && MoveFileExW(
+		(LPCWSTR)temp.get_data(), (LPCWSTR)target.get_data(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+	if (!ok) {
+		DeleteFileW((LPCWSTR)temp.get_data());
+		ERR_FAIL_V_MSG(ERR_FILE_CANT_WRITE, "Can't replace file '" + path + "'.");
+	}
+#else
+	const CharString temp = temp_path.utf8();
+	const CharString target = path.utf8();
+	int fd = ::open(temp.get_data(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+	ERR_FAIL_COND_V_MSG(fd == -1, ERR_FILE_CANT_WRITE, "Can't create file '" + temp_path + "'.");
+	bool ok = true;
+	while (ok && remaining > 0) {
+		const ssize_t written = ::write(fd, src, remaining);
+		if (written < 0) {
+			ok = errno == EINTR;
+			continue;
+		}
+		src += written;
+		remaining -= written;
+	}
+	ok = ok && ::fsync(fd) == 0;
+	ok = ::close(fd) == 0 && ok;
+	ok = ok && ::rename(temp.get_data(), target.get_data()) == 0;
+	if (!ok) {
+		::unlink(temp.get_data());
+		ERR_FAIL_V_MSG(ERR_FILE_CANT_WRITE, "Can't replace file '" + path + "'.");
+	}
+	// The rename is only on disk once the directory is
+	int dir = ::open(path.get_base_dir().utf8().get_data(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir != -1) {
+		::fsync(dir);
+		::close(dir);
+	}
+#endif
+	return OK;
+}
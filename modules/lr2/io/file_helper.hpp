@@ -61,4 +61,16 @@ inline void store_string(Ref<FileAccess> f, String str, int length) {
 	while (f->get_position() < end) {
 		f->store_8(0);
 	}
-}
\ No newline at end of file
+}
+
+// The rest of the file in one read, for parsing with a ByteCursor
+inline Vector<uint8_t> get_remaining_bytes(Ref<FileAccess> f) {
+	Vector<uint8_t> data;
+	data.resize(f->get_length() - f->get_position());
+	data.resize(f->get_buffer(data.ptrw(), data.size()));
+	return data;
+}
+
+// Writes to a new temporary file next to path, syncs it to disk, then renames it over path with the platform's
+// replace. Path is never left half written, even after a power cut, as long as the filesystem's rename is atomic.
+Error store_file_atomic(const String& path, const Vector<uint8_t>& data);
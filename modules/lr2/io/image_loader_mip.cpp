@@ -35,6 +35,9 @@
 #include "core/os/os.h"
 #include "core/string/print_string.h"
 
+#include "lr2/io/byte_cursor.hpp"
+#include "lr2/io/file_helper.hpp"
+
 Error ImageLoaderMIP::decode_tga_rle(
 	const uint8_t* p_compressed_buffer, size_t p_pixel_size, uint8_t* p_uncompressed_buffer, size_t p_output_size,
 	size_t p_input_size) {
@@ -54,6 +57,9 @@ Error ImageLoaderMIP::decode_tga_rle(
 	size_t count = 0;
 
 	while (output_pos < p_output_size) {
+		if (compressed_pos >= p_input_size) {
+			return ERR_PARSE_ERROR;
+		}
 		c = p_compressed_buffer[compressed_pos];
 		compressed_pos += 1;
 		count = (c & 0x7f) + 1;
@@ -260,29 +266,29 @@ Error ImageLoaderMIP::convert_to_image(
 
 Error ImageLoaderMIP::load_image(
 	Ref<Image> p_image, Ref<FileAccess> f, BitField<ImageFormatLoader::LoaderFlags> p_flags, float p_scale) {
-	Vector<uint8_t> src_image;
-	uint64_t src_image_len = f->get_length();
-	ERR_FAIL_COND_V(src_image_len == 0, ERR_FILE_CORRUPT);
-	ERR_FAIL_COND_V(src_image_len < (int64_t)sizeof(tga_header_s), ERR_FILE_CORRUPT);
-	src_image.resize(src_image_len);
+	// One read, the header is parsed from the buffer and the pixels are decoded in place
+	Vector<uint8_t> file_data = get_remaining_bytes(f);
+	ERR_FAIL_COND_V(file_data.size() == 0, ERR_FILE_CORRUPT);
+	ERR_FAIL_COND_V(file_data.size() < (int64_t)sizeof(tga_header_s), ERR_FILE_CORRUPT);
+	ByteCursor c(file_data);
 
 	Error err = OK;
 
 	tga_header_s tga_header;
-	tga_header.id_length = f->get_8();
-	tga_header.color_map_type = f->get_8();
-	tga_header.image_type = static_cast<tga_type_e>(f->get_8());
+	tga_header.id_length = c.get_8();
+	tga_header.color_map_type = c.get_8();
+	tga_header.image_type = static_cast<tga_type_e>(c.get_8());
 
-	tga_header.first_color_entry = f->get_16();
-	tga_header.color_map_length = f->get_16();
-	tga_header.color_map_depth = f->get_8();
+	tga_header.first_color_entry = c.get_16();
+	tga_header.color_map_length = c.get_16();
+	tga_header.color_map_depth = c.get_8();
 
-	tga_header.x_origin = f->get_16();
-	tga_header.y_origin = f->get_16();
-	tga_header.image_width = f->get_16();
-	tga_header.image_height = f->get_16();
-	tga_header.pixel_depth = f->get_8();
-	tga_header.image_descriptor = f->get_8();
+	tga_header.x_origin = c.get_16();
+	tga_header.y_origin = c.get_16();
+	tga_header.image_width = c.get_16();
+	tga_header.image_height = c.get_16();
+	tga_header.pixel_depth = c.get_8();
+	tga_header.image_descriptor = c.get_8();
 
 	bool is_encoded =
 		(tga_header.image_type == TGA_TYPE_RLE_INDEXED || tga_header.image_type == TGA_TYPE_RLE_RGB ||
@@ -316,42 +322,32 @@ Error ImageLoaderMIP::load_image(
 	}
 
 	if (err == OK) {
-		f->seek(f->get_position() + tga_header.id_length);
+		c.skip(tga_header.id_length);
 
-		Vector<uint8_t> palette;
+		const uint8_t* palette_r = nullptr;
 
 		if (has_color_map) {
 			size_t color_map_size = tga_header.color_map_length * (tga_header.color_map_depth >> 3);
-			err = palette.resize(color_map_size);
-			if (err == OK) {
-				uint8_t* palette_w = palette.ptrw();
-				f->get_buffer(&palette_w[0], color_map_size);
-			} else {
-				return OK;
-			}
+			ERR_FAIL_COND_V(c.get_remaining() < color_map_size, ERR_FILE_CORRUPT);
+			palette_r = c.ptr() + c.get_position();
+			c.skip(color_map_size);
 		}
 
-		uint8_t* src_image_w = src_image.ptrw();
-		f->get_buffer(&src_image_w[0], src_image_len - f->get_position());
-
-		const uint8_t* src_image_r = src_image.ptr();
+		const uint8_t* src_image_r = c.ptr() + MIN(c.get_position(), c.get_length());
+		const size_t src_image_len = c.get_remaining();
 
 		const size_t pixel_size = tga_header.pixel_depth >> 3;
 		size_t buffer_size = (tga_header.image_width * tga_header.image_height) * pixel_size;
 
 		Vector<uint8_t> uncompressed_buffer;
-		uncompressed_buffer.resize(buffer_size);
-		uint8_t* uncompressed_buffer_w = uncompressed_buffer.ptrw();
-		const uint8_t* uncompressed_buffer_r;
-
 		const uint8_t* buffer = nullptr;
 
 		if (is_encoded) {
-			err = decode_tga_rle(src_image_r, pixel_size, uncompressed_buffer_w, buffer_size, src_image_len);
+			uncompressed_buffer.resize(buffer_size);
+			err = decode_tga_rle(src_image_r, pixel_size, uncompressed_buffer.ptrw(), buffer_size, src_image_len);
 
 			if (err == OK) {
-				uncompressed_buffer_r = uncompressed_buffer.ptr();
-				buffer = uncompressed_buffer_r;
+				buffer = uncompressed_buffer.ptr();
 			}
 		} else {
 			buffer = src_image_r;
@@ -359,7 +355,6 @@ Error ImageLoaderMIP::load_image(
 		};
 
 		if (err == OK) {
-			const uint8_t* palette_r = palette.ptr();
 			err = convert_to_image(p_image, buffer, tga_header, palette_r, is_monochrome, buffer_size);
 		}
 	}
@@ -1,6 +1,8 @@
 #include "register_types.h"
 
+#include "assets/pick_shape.hpp"
 #include "assets/tdf.hpp"
+#include "assets/triangle_bvh.hpp"
 #include "core/config/engine.h"
 #include "init.hpp"
 #include "io/custom_file_dialog.hpp"
@@ -18,7 +20,9 @@ void initialize_lr2_module(ModuleInitializationLevel p_level) {
 
 	ClassDB::register_class<Init>();
 	ClassDB::register_class<CustomFileDialog>();
+	ClassDB::register_abstract_class<PickShape>();
 	ClassDB::register_class<TDF>();
+	ClassDB::register_class<TriangleBVH>();
 }
 
 extern Ref<Shader> tdf_shader;
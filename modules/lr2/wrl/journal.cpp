@@ -0,0 +1,213 @@
+#include "journal.hpp"
+
+#include "core/io/dir_access.h"
+#include "core/io/file_access_memory.h"
+#include "core/os/os.h"
+#include "core/os/time.h"
+
+#include "lr2/io/byte_cursor.hpp"
+#include "lr2/io/file_helper.hpp"
+
+const String Journal::journal_path = "user://autosave.journal";
+
+const uint32_t JOURNAL_MAGIC = 0x4a32524c;
+const uint32_t JOURNAL_VERSION = 1;
+const uint64_t min_compact_size = 4 << 20; // Bytes of changes, below this a snapshot isn't worth writing
+const uint64_t flush_delay_usec = 1000000; // The most recent changes a crash can lose
+
+// Layout:
+//   u32 magic, u32 version, u32 length + world path, u64 length + snapshot WRL, or 0 to start from the world path
+//   Then a record per change: u32 length, u32 count + added entries, u32 count + changed properties
+//   Added entries are the type then the row as in a WRL chunk, properties are the scene index, the property index and
+//   the value as in a WRL chunk
+void Journal::start(const Vector<uint8_t>& snapshot) {
+	ByteWriter w;
+	w.store_32(JOURNAL_MAGIC);
+	w.store_32(JOURNAL_VERSION);
+	CharString path = world_path.utf8();
+	w.store_32(path.length());
+	w.store_buffer((const uint8_t*)path.ptr(), path.length());
+	w.store_64(snapshot.size());
+	w.store_buffer(snapshot.ptr(), snapshot.size());
+	Vector<uint8_t> header = w.finish();
+
+	file.unref(); // Closed before it's replaced
+	ERR_FAIL_COND_MSG(store_file_atomic(journal_path, header) != OK, "Couldn't start the journal, autosave is off");
+	file = FileAccess::open(journal_path, FileAccess::READ_WRITE);
+	ERR_FAIL_COND_MSG(file.is_null(), "Couldn't open the journal, autosave is off");
+	file->seek_end();
+	flush_usec = 0;
+
+	compact_size = header.size() + MAX(min_compact_size, uint64_t(snapshot.size()));
+	unsaved = !snapshot.is_empty();
+}
+
+void Journal::compact() { start(wrl->save_to_buffer()); }
+
+void Journal::reset(const String& p_world_path) {
+	world_path = p_world_path;
+	start(Vector<uint8_t>());
+}
+
+void Journal::record(const WRL::Change& change) {
+	ByteWriter w;
+	w.store_32(0); // Length, filled in below
+
+	// Added entries are stored whole, their properties aren't in propertyChanges
+	w.store_32(change.added.size());
+	for (const auto& a : change.added) {
+		w.store_string(wrl->get_entry_format(a.value).type, 24);
+		wrl->store_entry_row(a.value, w);
+	}
+
+	const uint64_t count_position = w.get_position();
+	w.store_32(0);
+	uint32_t count = 0;
+	for (const auto& p : change.propertyChanges) {
+		const int index = wrl->get_index(p.key.first);
+		const WRL::Location l = wrl->get_location(p.key.first);
+		w.store_32(index);
+		w.store_32(p.key.second.index);
+		wrl->get_table(l.table).columns[p.key.second.index].store(w, l.row);
+		count++;
+	}
+
+	if (change.added.is_empty() && count == 0)
+		return;
+
+	const uint64_t end = w.get_position();
+	w.seek(0);
+	w.store_32(end - 4);
+	w.seek(count_position);
+	w.store_32(count);
+
+	Vector<uint8_t> data = w.finish();
+	file->store_buffer(data.ptr(), data.size());
+	if (!flush_usec)
+		flush_usec = OS::get_singleton()->get_ticks_usec() + flush_delay_usec;
+	unsaved = true;
+
+	if (file->get_position() >= compact_size) {
+		compact();
+	}
+}
+
+void Journal::_wrl_changed(const WRL::Change& change, bool reset) {
+	// Resets come from loading or clearing, which the owner follows with a call to reset()
+	if (reset || replaying || file.is_null())
+		return;
+	record(change);
+}
+
+Error Journal::replay(ByteCursor& c) {
+	while (c.get_remaining() > 0) {
+		ByteCursor r = c.get_chunk(c.get_32());
+		if (r.has_overrun()) {
+			WARN_PRINT("Dropped the last change in the journal, it wasn't finished being written");
+			break;
+		}
+
+		const uint32_t added = r.get_32();
+		for (uint32_t i = 0; i < added; i++) {
+			String type = r.get_string(24);
+			ERR_FAIL_COND_V(!wrl->add_entry_row(type, r), ERR_FILE_CORRUPT);
+		}
+
+		const uint32_t count = r.get_32();
+		WRL::Change change;
+		for (uint32_t i = 0; i < count; i++) {
+			const uint32_t index = r.get_32();
+			const WRL::PropertyID prop{int(r.get_32())};
+			ERR_FAIL_COND_V(index >= uint32_t(wrl->get_scene_size()), ERR_FILE_CORRUPT);
+			const WRL::EntryID entry = wrl->get_scene_entry(index);
+			const WRL::Location l = wrl->get_location(entry);
+			const WRL::Table& table = wrl->get_table(l.table);
+			ERR_FAIL_INDEX_V(prop.index, table.columns.size(), ERR_FILE_CORRUPT);
+
+			WRL::Column value{.type = table.columns[prop.index].type, .length = table.columns[prop.index].length};
+			value.resize(1);
+			value.read(r, 0);
+			change.propertyChanges.insert({entry, prop}, value.get(0));
+		}
+		ERR_FAIL_COND_V(r.has_overrun(), ERR_FILE_CORRUPT);
+
+		if (!change.propertyChanges.is_empty()) {
+			wrl->apply_change(change);
+		}
+	}
+	return OK;
+}
+
+Error Journal::recover(const CustomFS& custom_fs, String& r_world_path, AssetManager* assets) {
+	if (!FileAccess::exists(journal_path))
+		return ERR_FILE_NOT_FOUND;
+
+	Vector<uint8_t> bytes = FileAccess::get_file_as_bytes(journal_path);
+	ByteCursor c(bytes);
+	ERR_FAIL_COND_V_MSG(c.get_32() != JOURNAL_MAGIC, ERR_FILE_UNRECOGNIZED, "Not a journal file.");
+	ERR_FAIL_COND_V_MSG(c.get_32() != JOURNAL_VERSION, ERR_FILE_UNRECOGNIZED, "Wrong journal version");
+	const uint32_t path_length = c.get_32();
+	ERR_FAIL_COND_V_MSG(path_length > c.get_remaining(), ERR_FILE_CORRUPT, "Truncated journal header");
+	String path = c.get_string(path_length);
+	ByteCursor snapshot = c.get_chunk(c.get_64());
+	ERR_FAIL_COND_V_MSG(c.has_overrun(), ERR_FILE_CORRUPT, "Truncated journal header");
+
+	replaying = true;
+	Error err = OK;
+	if (snapshot.get_length() > 0) {
+		FileAccessMemory* memory = memnew(FileAccessMemory);
+		Ref<FileAccess> f(memory);
+		memory->open_custom(snapshot.ptr(), snapshot.get_length());
+		err = wrl->load(f, assets);
+	} else if (!path.is_empty()) {
+		Ref<FileAccess> f = custom_fs.FileAccess_open(path, FileAccess::READ, &err);
+		if (f.is_valid()) {
+			err = wrl->load(f, assets);
+		}
+	} else {
+		wrl->clear();
+	}
+	if (err != OK) {
+		replaying = false;
+		ERR_FAIL_V_MSG(err, "Couldn't load the world the journal starts from");
+	}
+
+	const bool changed = c.get_remaining() > 0;
+	if (replay(c) != OK) {
+		ERR_PRINT("The journal is damaged, only the changes before the damage were recovered");
+	}
+	replaying = false;
+
+	world_path = path;
+	if (changed || snapshot.get_length() > 0) {
+		compact();
+	} else {
+		start(Vector<uint8_t>());
+	}
+	r_world_path = path;
+	return OK;
+}
+
+void Journal::poll() {
+	if (flush_usec && OS::get_singleton()->get_ticks_usec() >= flush_usec && file.is_valid()) {
+		file->flush();
+		flush_usec = 0;
+	}
+}
+
+String Journal::set_aside() {
+	file.unref();
+	const String kept_path =
+		journal_path.get_basename() + "_" + itos(Time::get_singleton()->get_unix_time_from_system()) + ".journal.bad";
+	Ref<DirAccess> da = DirAccess::create_for_path(journal_path);
+	ERR_FAIL_COND_V_MSG(da->rename(journal_path, kept_path) != OK, String(), "Couldn't move the journal aside");
+	return kept_path;
+}
+
+Journal::~Journal() {
+	// Nothing to recover next time, otherwise the unsaved changes are left for it
+	if (file.is_valid() && !unsaved) {
+		file.unref();
+		DirAccess::remove_absolute(journal_path);
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "core/io/file_access.h"
+
+#include "lr2/io/custom_fs.hpp"
+#include "lr2/wrl/wrl.hpp"
+
+// Autosave for a WRL, every change is appended to a journal file as it's made. The journal starts with the world it
+// applies to, either the path of the saved file or a full snapshot of the world when it isn't saved, so after a crash
+// the world is recovered by loading that and replaying the changes. Once the changes outgrow the snapshot they're
+// compacted into a new one.
+class Journal : public WRL::EventHandler {
+  private:
+	static const String journal_path;
+
+	Ref<FileAccess> file;
+	String world_path;
+	uint64_t compact_size = 0; // Journal length to compact at
+	uint64_t flush_usec = 0; // When the changes written since the last flush are due to reach the disk, 0 if none
+	bool unsaved = false; // Whether the journal holds anything the world file doesn't
+	bool replaying = false;
+
+	void start(const Vector<uint8_t>& snapshot);
+	void compact();
+	void record(const WRL::Change&);
+	Error replay(ByteCursor&);
+
+  protected:
+	void _wrl_changed(const WRL::Change&, bool reset) override;
+	bool lite_init() override { return true; }
+
+  public:
+	// Loads the world from the journal left by the last run, if there is one, returning the world's path
+	Error recover(const CustomFS&, String& r_world_path, AssetManager* assets = nullptr);
+	// Moves a journal that couldn't be recovered out of the way so reset() doesn't overwrite it, returning where it
+	// went, or an empty string if it couldn't be moved
+	String set_aside();
+	// Drops the journal, the world now matches the file at world_path, or is empty if that's empty
+	void reset(const String& world_path);
+	// Flushes changes once they've waited flush_delay_usec, call it every frame. Until then they sit in the file's
+	// buffer, so a drag costs one flush rather than one per step.
+	void poll();
+
+	~Journal();
+};
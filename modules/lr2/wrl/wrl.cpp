@@ -1,216 +1,663 @@
 #include "wrl.hpp"
 
+#include "core/templates/local_vector.h"
+
+#include "lr2/assets/asset_manager.hpp"
+#include "lr2/debug/profiler.hpp"
+#include "lr2/io/byte_cursor.hpp"
 #include "lr2/io/file_helper.hpp"
 
-size_t WRL::Format::find_property(const String& name) const {
+WRL::PropertyID WRL::Format::find_property(const String& name) const {
 	for (int i = 0; i < properties.size(); i++) {
 		if (name == properties[i].name)
-			return i;
+			return {i};
 	}
 	throw std::out_of_range("");
 }
 
-const Variant& WRL::Entry::get(const String& name) const {
-	auto i = format.find_property(name);
-	return properties[i];
+void WRL::Format::resolve_model() {
+	auto resolve = [&](const String& name) { return name.is_empty() ? PropertyID() : find_property(name); };
+	model.model_id = resolve(model.model);
+	model.position_id = resolve(model.position);
+	model.rotation_id = resolve(model.rotation);
+	model.scale_id = resolve(model.scale);
+	model.uniform_ids.clear();
+	for (const String& uniform : model.uniforms) {
+		model.uniform_ids.push_back(find_property(uniform));
+	}
 }
 
-void WRL::Entry::set(const String& name, const Variant& value) {
-	auto i = format.find_property(name);
-	const WRL::Format::Property& prop = format.properties[i];
-	if (value.get_type() != prop.type)
-		throw std::invalid_argument("");
-	properties.set(i, value);
+Variant WRL::Column::get(int row) const {
+	switch (type) {
+		case Variant::INT:
+			return ints[row];
+		case Variant::FLOAT:
+			return floats[row];
+		case Variant::VECTOR2:
+			return vector2s[row];
+		case Variant::VECTOR3:
+			return vector3s[row];
+		case Variant::QUATERNION:
+			return quaternions[row];
+		case Variant::STRING:
+			return get_string(row);
+		default: {
+			Vector<uint8_t> ret;
+			ret.resize(length);
+			memcpy(ret.ptrw(), bytes.ptr() + row * length, length);
+			return ret;
+		}
+	}
 }
 
-int WRL::get_index(String name) const {
-	for (int i = 0; i < scene.size(); i++) {
-		if (entries[scene[i].id].get<String>("name") == name) {
-			return i;
-		}
+String WRL::Column::get_string(int row) const { return ByteCursor(bytes.ptr() + row * length, length).get_string(length); }
+
+void WRL::Column::set(int row, const Variant& value) {
+	if (value.get_type() != type)
+		throw std::invalid_argument("");
+	switch (type) {
+		case Variant::INT:
+			ints.write[row] = uint32_t(int64_t(value));
+			break;
+		case Variant::FLOAT:
+			floats.write[row] = value;
+			break;
+		case Variant::VECTOR2:
+			vector2s.write[row] = value;
+			break;
+		case Variant::VECTOR3:
+			vector3s.write[row] = value;
+			break;
+		case Variant::QUATERNION:
+			quaternions.write[row] = value;
+			break;
+		case Variant::STRING: {
+			// Cut to fit, the same as the file will have it
+			CharString cs = String(value).ascii();
+			uint8_t* dst = bytes.ptrw() + row * length;
+			uint32_t copied = MIN(uint32_t(cs.length()), length);
+			memcpy(dst, cs.ptr(), copied);
+			memset(dst + copied, 0, length - copied);
+		} break;
+		default: {
+			Vector<uint8_t> data = value;
+			uint8_t* dst = bytes.ptrw() + row * length;
+			uint32_t copied = MIN(uint32_t(data.size()), length);
+			memcpy(dst, data.ptr(), copied);
+			memset(dst + copied, 0, length - copied);
+		} break;
 	}
-	return -1;
 }
 
-const WRL::Format& WRL::get_entry_format(EntryID id) const { return entries[id.id].format; }
-Variant WRL::get_entry_property(EntryID id, String prop_name) const { return entries[id.id].get(prop_name); }
+void WRL::Column::append_default() {
+	switch (type) {
+		case Variant::INT:
+			ints.push_back(0);
+			break;
+		case Variant::FLOAT:
+			floats.push_back(0);
+			break;
+		case Variant::VECTOR2:
+			vector2s.push_back(Vector2());
+			break;
+		case Variant::VECTOR3:
+			vector3s.push_back(Vector3());
+			break;
+		case Variant::QUATERNION:
+			quaternions.push_back(Quaternion());
+			break;
+		default: {
+			int64_t end = bytes.size();
+			bytes.resize(end + length);
+			memset(bytes.ptrw() + end, 0, length);
+		} break;
+	}
+}
 
-void WRL::submit_change(const Change& change, String action_name) {
-	for (const auto& prop : change.propertyChanges) {
-		entries.write[prop.key.first.id].set(prop.key.second, prop.value);
+void WRL::Column::resize(int rows) {
+	switch (type) {
+		case Variant::INT:
+			ints.resize(rows);
+			break;
+		case Variant::FLOAT:
+			floats.resize(rows);
+			break;
+		case Variant::VECTOR2:
+			vector2s.resize(rows);
+			break;
+		case Variant::VECTOR3:
+			vector3s.resize(rows);
+			break;
+		case Variant::QUATERNION:
+			quaternions.resize(rows);
+			break;
+		default:
+			bytes.resize(int64_t(rows) * length);
+			break;
 	}
-	emit_change(change);
 }
 
-void WRL::select(EntryID id) {
-	int index = get_index(id);
-	emit_change(Change{.select_changed = true, .select = {index, id}});
+// ptrw only copies when the vector is shared, and columns never are while loading, so threads can write rows
+void WRL::Column::read(ByteCursor& c, int row) {
+	switch (type) {
+		case Variant::INT:
+			ints.ptrw()[row] = c.get_32();
+			break;
+		case Variant::FLOAT:
+			floats.ptrw()[row] = c.get_float();
+			break;
+		case Variant::VECTOR2:
+			vector2s.ptrw()[row] = c.get_vector2();
+			break;
+		case Variant::VECTOR3:
+			vector3s.ptrw()[row] = c.get_vector3();
+			break;
+		case Variant::QUATERNION:
+			quaternions.ptrw()[row] = c.get_quaternion();
+			break;
+		default: {
+			uint8_t* dst = bytes.ptrw() + int64_t(row) * length;
+			uint64_t read = c.get_buffer(dst, length);
+			memset(dst + read, 0, length - read);
+		} break;
+	}
 }
 
-void WRL::clear() {
-	emit_change(Change{.removed = get_scene_map(), .select_changed = true, .select = {-1, EntryID()}}, true);
-	scene.clear();
-	regen_scene_map = true;
-	entries.clear();
+uint32_t WRL::Column::get_size() const {
+	switch (type) {
+		case Variant::INT:
+		case Variant::FLOAT:
+			return 4;
+		case Variant::VECTOR2:
+			return 8;
+		case Variant::VECTOR3:
+			return 12;
+		case Variant::QUATERNION:
+			return 16;
+		default:
+			return length;
+	}
 }
 
-const uint32_t WRL_MAGIC = 0x57324352;
-const uint32_t WRL_VERSION = 0xb;
-const uint32_t OBMG_MAGIC = 0x474d424f;
+void WRL::Column::store(ByteWriter& w, int row) const {
+	switch (type) {
+		case Variant::INT:
+			w.store_32(ints[row]);
+			break;
+		case Variant::FLOAT:
+			w.store_float(floats[row]);
+			break;
+		case Variant::VECTOR2:
+			w.store_vector2(vector2s[row]);
+			break;
+		case Variant::VECTOR3:
+			w.store_vector3(vector3s[row]);
+			break;
+		case Variant::QUATERNION:
+			w.store_quaternion(quaternions[row]);
+			break;
+		default:
+			w.store_buffer(bytes.ptr() + int64_t(row) * length, length);
+			break;
+	}
+}
 
-Error WRL::load(Ref<FileAccess> file) {
-	const HashMap<String, Format>& load_types = get_formats();
+int WRL::find_or_add_table(const Format* format, const String& key) {
+	const int* found = table_index.getptr(key);
+	if (found)
+		return *found;
+
+	Table table{.format = format};
+	for (const Format::Property& prop : format->properties) {
+		switch (prop.type) {
+			case Variant::INT:
+			case Variant::FLOAT:
+			case Variant::VECTOR2:
+			case Variant::VECTOR3:
+			case Variant::QUATERNION:
+			case Variant::STRING:
+			case Variant::PACKED_BYTE_ARRAY:
+				break;
+			default:
+				ERR_FAIL_V_MSG(-1, "Unsupported property type in " + format->type + ": " + prop.name);
+		}
+		table.columns.push_back(Column{.type = prop.type, .length = prop.length});
+		table.row_size += table.columns[table.columns.size() - 1].get_size();
+	}
+	tables.push_back(table);
+	table_index.insert(key, tables.size() - 1);
+	return tables.size() - 1;
+}
 
-	clear();
+WRL::EntryID WRL::append_entry(int table) {
+	Table& t = tables.write[table];
+	EntryID id{entries.size()};
+	entries.push_back({table, t.rows.size()});
+	t.rows.push_back(id);
+	scene_index.push_back(scene.size());
+	scene.push_back(id);
+	return id;
+}
 
-	ERR_FAIL_COND_V_MSG(file->get_32() != WRL_MAGIC, ERR_FILE_UNRECOGNIZED, "Not a WRL file.");
-	ERR_FAIL_COND_V_MSG(file->get_32() != WRL_VERSION, ERR_FILE_UNRECOGNIZED, "Wrong WRL version");
+void WRL::index_name(EntryID id) { name_index[get_name(id)].push_back(id); }
 
-	uint64_t next_chunk = 8;
-	while (file->get_length() > next_chunk) {
-		file->seek(next_chunk);
-		ERR_FAIL_COND_V_MSG(file->get_32() != OBMG_MAGIC, ERR_FILE_CORRUPT, "Couldn't find OBMG header");
+void WRL::unindex_name(EntryID id) {
+	const String name = get_name(id);
+	Vector<EntryID>* ids = name_index.getptr(name);
+	if (ids) {
+		ids->erase(id);
+		if (ids->is_empty())
+			name_index.erase(name);
+	}
+}
 
-		String type = get_string(file, 24);
-		uint32_t u = file->get_32();
+int WRL::get_index(String name) const {
+	const Vector<EntryID>* ids = name_index.getptr(name);
+	if (!ids)
+		return -1;
+	int ret = -1;
+	for (const EntryID& id : *ids) {
+		const int index = scene_index[id.id];
+		if (ret == -1 || index < ret)
+			ret = index;
+	}
+	return ret;
+}
 
-		uint32_t length = file->get_32();
-		next_chunk = file->get_position() + length;
+void WRL::set_properties(const Change::PropertyMap& properties) {
+	for (const auto& prop : properties) {
+		const bool rename = prop.key.second == name_property;
+		if (rename)
+			unindex_name(prop.key.first);
+		const Location& l = entries[prop.key.first.id];
+		tables.write[l.table].columns.write[prop.key.second.index].set(l.row, prop.value);
+		if (rename)
+			index_name(prop.key.first);
+	}
+}
 
-		Format format;
-		if (load_types.has(type) && load_types[type].type == type && load_types[type].u == u) {
-			format = load_types[type];
+void WRL::record_action(const Change::PropertyMap& properties, const String& name, bool merge) {
+	// Nothing merges into an action that's been undone
+	merge = merge && history_done > 0 && history_done == history_size &&
+			history[history_slot(history_done - 1)].name == name;
+	if (!merge) {
+		// A new action drops the ones that could be redone, and the oldest when full
+		history_size = history_done;
+		if (history_size == history_capacity) {
+			history_start = history_slot(1);
+			history_size--;
+		}
+		const int slot = history_slot(history_size);
+		if (slot == history.size()) {
+			history.push_back(Action{.name = name});
 		} else {
-			format = Format{type, u};
-			format.properties.append_array(common_properties);
-			format.properties.push_back({Variant::PACKED_BYTE_ARRAY, "data", length - 28});
+			history.write[slot] = Action{.name = name};
 		}
+		history_size++;
+		history_done = history_size;
+	}
 
-		Entry entry{.format = format};
-		entry.properties.resize(format.properties.size());
+	// Only the first old value of each property is kept, so a merged action undoes back to where it started
+	Action& action = history.write[history_slot(history_done - 1)];
+	for (const auto& prop : properties) {
+		if (!action.before.has(prop.key)) {
+			action.before.insert(prop.key, get_entry_property(prop.key.first, prop.key.second));
+		}
+		action.after[prop.key] = prop.value;
+	}
+}
 
-		for (auto prop : format.properties) {
-			if (prop.type == Variant::INT) {
-				entry.set(prop.name, file->get_32());
-			}
+void WRL::submit_change(const Change& change, String action_name, bool merge) {
+	if (!change.propertyChanges.is_empty()) {
+		record_action(change.propertyChanges, action_name, merge);
+		set_properties(change.propertyChanges);
+	}
+	emit_change(change);
+}
 
-			else if (prop.type == Variant::FLOAT) {
-				entry.set(prop.name, file->get_float());
-			}
+void WRL::apply_change(const Change& change) {
+	set_properties(change.propertyChanges);
+	emit_change(change);
+}
 
-			else if (prop.type == Variant::STRING) {
-				entry.set(prop.name, get_string(file, prop.length));
-			}
+bool WRL::undo() {
+	if (history_done == 0)
+		return false;
+	history_done--;
+	const Action& action = history[history_slot(history_done)];
+	set_properties(action.before);
+	emit_change(Change{.propertyChanges = action.before});
+	return true;
+}
 
-			else if (prop.type == Variant::VECTOR2) {
-				entry.set(prop.name, get_vector2(file));
-			}
+bool WRL::redo() {
+	if (history_done == history_size)
+		return false;
+	const Action& action = history[history_slot(history_done)];
+	history_done++;
+	set_properties(action.after);
+	emit_change(Change{.propertyChanges = action.after});
+	return true;
+}
 
-			else if (prop.type == Variant::VECTOR3) {
-				entry.set(prop.name, get_vector3(file));
-			}
+void WRL::select(EntryID id) {
+	int index = get_index(id);
+	emit_change(Change{.select_changed = true, .select = {index, id}});
+}
 
-			else if (prop.type == Variant::QUATERNION) {
-				entry.set(prop.name, get_quaternion(file));
-			}
+void WRL::clear() {
+	// The history goes first so handlers see it empty, the scene is still there for them to read what's removed
+	history.clear();
+	history_start = history_size = history_done = 0;
+	emit_change(Change{.removed = EntrySet(scene), .select_changed = true, .select = {-1, EntryID()}}, true);
+	clear_entries();
+}
 
-			else if (prop.type == Variant::PACKED_BYTE_ARRAY) {
-				Vector<uint8_t> data;
-				data.resize(prop.length);
-				file->get_buffer(data.ptrw(), data.size());
-				entry.set(prop.name, data);
-			}
+void WRL::clear_entries() {
+	scene.clear();
+	scene_index.clear();
+	entries.clear();
+	tables.clear();
+	table_index.clear();
+	raw_formats.clear();
+	name_index.clear();
+}
 
-			else {
-				return Error::ERR_FILE_UNRECOGNIZED;
-			}
-		}
+WRL::EntryID WRL::add_entry(const String& type, const HashMap<String, Variant>& values) {
+	const HashMap<String, Format>& formats = get_formats();
+	ERR_FAIL_COND_V_MSG(!formats.has(type), EntryID(), "Unknown entry type: " + type);
+	const Format& format = formats[type];
 
-		scene.append(EntryID{entries.size()});
-		entries.append(entry);
+	// Checked before anything is added, so a bad value leaves the world as it was
+	for (const auto& v : values) {
+		if (v.value.get_type() != format.properties[format.find_property(v.key).index].type)
+			throw std::invalid_argument("");
+	}
 
-		if (file->get_position() != next_chunk) {
-			WARN_PRINT("Wrong amount of data read: " + type);
-		}
+	int table = find_or_add_table(&format, type + ":" + itos(format.u));
+	ERR_FAIL_COND_V(table == -1, EntryID());
+	Table& t = tables.write[table];
+	for (int i = 0; i < t.columns.size(); i++) {
+		t.columns.write[i].append_default();
 	}
-	regen_scene_map = true;
-	emit_change(Change{.added = get_scene_map()}, true);
-	return OK;
+	for (const auto& v : values) {
+		t.columns.write[format.find_property(v.key).index].set(t.rows.size(), v.value);
+	}
+	EntryID id = append_entry(table);
+	index_name(id);
+	emit_added(id);
+	return id;
 }
 
-Error WRL::save(Ref<FileAccess> file) {
-	file->store_32(WRL_MAGIC);
-	file->store_32(WRL_VERSION);
+WRL::EntryID WRL::add_entry_row(const String& type, ByteCursor& data) {
+	const HashMap<String, Format>& formats = get_formats();
+	ERR_FAIL_COND_V_MSG(!formats.has(type), EntryID(), "Unknown entry type: " + type);
+	const Format& format = formats[type];
+
+	int table = find_or_add_table(&format, type + ":" + itos(format.u));
+	ERR_FAIL_COND_V(table == -1, EntryID());
+	Table& t = tables.write[table];
+	for (int i = 0; i < t.columns.size(); i++) {
+		Column& column = t.columns.write[i];
+		column.append_default();
+		column.read(data, t.rows.size());
+	}
+	EntryID id = append_entry(table);
+	index_name(id);
+	emit_added(id);
+	return id;
+}
 
-	for (auto i : scene) {
-		const Entry& entry = entries[i.id];
-		file->store_32(OBMG_MAGIC);
-		store_string(file, entry.format.type, 24);
-		file->store_32(entry.format.u);
+void WRL::store_entry_row(EntryID id, ByteWriter& w) const {
+	const Location& l = entries[id.id];
+	for (const Column& column : tables[l.table].columns) {
+		column.store(w, l.row);
+	}
+}
 
-		file->store_32(0); // Placeholder for length
-		uint64_t length_start = file->get_position();
+void WRL::emit_added(EntryID id) {
+	EntrySet added;
+	added.insert(scene_index[id.id], id);
+	emit_change(Change{.added = added});
+}
 
-		for (auto prop : entry.format.properties) {
-			if (prop.type == Variant::INT) {
-				file->store_32(entry.get(prop.name));
-			}
+const uint32_t WRL_MAGIC = 0x57324352;
+const uint32_t WRL_VERSION = 0xb;
+const uint32_t OBMG_MAGIC = 0x474d424f;
+const uint32_t parallel_load_threshold = 1024; // Entries, below this starting the threads costs more than it saves
 
-			else if (prop.type == Variant::FLOAT) {
-				file->store_float(entry.get(prop.name));
-			}
+Error WRL::load(Ref<FileAccess> file, AssetManager* assets) {
+	const HashMap<String, Format>& load_types = get_formats();
 
-			else if (prop.type == Variant::STRING) {
-				store_string(file, entry.get(prop.name), prop.length);
+	clear();
+	ERR_FAIL_COND_V(file.is_null(), ERR_INVALID_PARAMETER);
+
+	Vector<uint8_t> bytes = get_remaining_bytes(file);
+	ByteCursor c(bytes);
+
+	ERR_FAIL_COND_V_MSG(c.get_32() != WRL_MAGIC, ERR_FILE_UNRECOGNIZED, "Not a WRL file.");
+	ERR_FAIL_COND_V_MSG(c.get_32() != WRL_VERSION, ERR_FILE_UNRECOGNIZED, "Wrong WRL version");
+
+	// One quick pass over the headers finds every entry's table and row, then the chunks are decoded in parallel
+	// straight into the columns
+	struct Chunk {
+		int table;
+		int row;
+		ByteCursor data;
+	};
+	LocalVector<Chunk> chunks;
+	// Stops at the first bad chunk
+	auto scan = [&]() -> Error {
+		while (c.get_remaining() > 0) {
+			ERR_FAIL_COND_V_MSG(c.get_32() != OBMG_MAGIC, ERR_FILE_CORRUPT, "Couldn't find OBMG header");
+
+			String type = c.get_string(24);
+			uint32_t u = c.get_32();
+
+			uint32_t length = c.get_32();
+			ByteCursor chunk = c.get_chunk(length);
+			ERR_FAIL_COND_V_MSG(chunk.has_overrun(), ERR_FILE_CORRUPT, "Truncated entry: " + type);
+			ERR_FAIL_COND_V_MSG(length < 28, ERR_FILE_CORRUPT, "Entry too short: " + type);
+
+			int table;
+			const Format* known = load_types.getptr(type);
+			if (known && known->type == type && known->u == u) {
+				table = find_or_add_table(known, type + ":" + itos(u));
+			} else {
+				// Unknown types are kept as raw data, which can be a different length for each entry
+				String key = type + ":" + itos(u) + ":" + itos(length);
+				const int* found = table_index.getptr(key);
+				if (found) {
+					table = *found;
+				} else {
+					Format& format = raw_formats.push_back(Format{type, u})->get();
+					format.properties.append_array(common_properties);
+					format.properties.push_back({Variant::PACKED_BYTE_ARRAY, "data", length - 28});
+					table = find_or_add_table(&format, key);
+				}
 			}
+			if (table == -1)
+				return Error::ERR_FILE_UNRECOGNIZED;
 
-			else if (prop.type == Variant::VECTOR2) {
-				store_vector2(file, entry.get(prop.name));
+			if (tables[table].row_size != length) {
+				WARN_PRINT("Wrong amount of data read: " + type);
 			}
 
-			else if (prop.type == Variant::VECTOR3) {
-				store_vector3(file, entry.get(prop.name));
-			}
+			chunks.push_back({table, tables[table].rows.size(), chunk});
+			append_entry(table);
+		}
+		return OK;
+	};
+	Error err;
+	{
+		PROFILE_SCOPE("WRL scan");
+		err = scan();
+	}
+	if (err != OK) {
+		// Handlers haven't heard of any of it, clear() already told them the world is empty
+		clear_entries();
+		return err;
+	}
 
-			else if (prop.type == Variant::QUATERNION) {
-				store_quaternion(file, entry.get(prop.name));
-			}
+	LocalVector<Column*> table_columns;
+	table_columns.resize(tables.size());
+	for (int t = 0; t < tables.size(); t++) {
+		Table& table = tables.write[t];
+		for (Column& column : table.columns) {
+			column.resize(table.rows.size());
+		}
+		table_columns[t] = table.columns.ptrw();
+	}
 
-			else if (prop.type == Variant::PACKED_BYTE_ARRAY) {
-				Vector<uint8_t> data = entry.get(prop.name);
-				file->store_buffer(data.ptr(), prop.length);
+	{
+		PROFILE_SCOPE("WRL decode");
+		auto decode = [&](int i) {
+			ByteCursor data = chunks[i].data;
+			Column* columns = table_columns[chunks[i].table];
+			const int column_count = tables[chunks[i].table].columns.size();
+			for (int col = 0; col < column_count; col++) {
+				columns[col].read(data, chunks[i].row);
 			}
-
-			else {
-				return Error::ERR_FILE_UNRECOGNIZED;
+		};
+		if (assets && chunks.size() >= parallel_load_threshold) {
+			assets->parallel_for(chunks.size(), decode);
+		} else {
+			for (uint32_t i = 0; i < chunks.size(); i++) {
+				decode(i);
 			}
 		}
+	}
 
-		uint64_t length = file->get_position() - length_start;
-		file->seek(length_start - 4);
-		file->store_32(length);
-		file->seek(length_start + length);
+	{
+		PROFILE_SCOPE("WRL index");
+		for (int i = 0; i < entries.size(); i++) {
+			index_name(EntryID{i});
+		}
 	}
 
+	emit_change(Change{.added = EntrySet(scene)}, true);
 	return OK;
 }
 
-void WRL::fixup_change(Change& change) {
-	for (const auto& add : change.added) {
-		EntryID entry = add.value;
-		auto prop_list = get_entry_format(entry).properties;
-		for (auto prop : prop_list) {
-			Pair<EntryID, String> change_key(entry, prop.name);
-			if (!change.propertyChanges.has(change_key)) {
-				change.propertyChanges.insert(change_key, get_entry_property(entry, prop.name));
+Vector<uint8_t> WRL::save_to_buffer() const {
+	PROFILE_SCOPE("WRL save");
+
+	// Every chunk's length is known from its table, so the whole file is sized up front and written in order
+	const uint32_t header_size = 4 + 24 + 4 + 4;
+	uint64_t size = 8;
+	for (const EntryID& i : scene) {
+		size += header_size + tables[entries[i.id].table].row_size;
+	}
+
+	ByteWriter w;
+	w.reserve(size);
+	w.store_32(WRL_MAGIC);
+	w.store_32(WRL_VERSION);
+
+	for (const EntryID& i : scene) {
+		const Location& l = entries[i.id];
+		const Table& table = tables[l.table];
+		w.store_32(OBMG_MAGIC);
+		w.store_string(table.format->type, 24);
+		w.store_32(table.format->u);
+		w.store_32(table.row_size);
+		store_entry_row(i, w);
+	}
+
+	DEV_ASSERT(w.get_length() == size);
+	return w.finish();
+}
+
+Error WRL::save(Ref<FileAccess> file) const {
+	Vector<uint8_t> data = save_to_buffer();
+	file->store_buffer(data.ptr(), data.size());
+	return file->get_error();
+}
+
+void WRL::emit_change(const Change& change, bool reset) {
+	// Copied since handlers can connect and disconnect while they're called
+	Vector<EventHandler*> handlers = event_handlers;
+	if (reset || change.select_changed) {
+		// Rare, and whatever a handler follows may have been replaced
+		handlers.append_array(subscribed_handlers);
+	} else if (!subscribed_handlers.is_empty()) {
+		auto add = [&](const Vector<EventHandler*>* subscribed) {
+			if (subscribed) {
+				for (EventHandler* handler : *subscribed) {
+					if (!handlers.has(handler))
+						handlers.push_back(handler);
+				}
 			}
+		};
+		for (const auto& prop : change.propertyChanges) {
+			add(property_handlers.getptr(prop.key));
+			add(entry_handlers.getptr(prop.key.first));
+		}
+		for (const auto& r : change.removed) {
+			add(entry_watchers.getptr(r.value));
+		}
+		for (const auto& a : change.added) {
+			add(entry_watchers.getptr(a.value));
 		}
 	}
-}
 
-void WRL::emit_change(Change change, bool reset) {
-	fixup_change(change);
-	for (auto handler : event_handlers.duplicate()) {
+	for (EventHandler* handler : handlers) {
 		handler->_wrl_changed(change, reset);
 	}
 }
+
+void WRL::add_handler(EventHandler* handler) {
+	handler->subscription = handler->get_subscription();
+	if (handler->subscription.is_all()) {
+		event_handlers.push_back(handler);
+		return;
+	}
+	subscribed_handlers.push_back(handler);
+	auto watch = [&](EntryID entry) {
+		Vector<EventHandler*>& watchers = entry_watchers[entry];
+		if (!watchers.has(handler))
+			watchers.push_back(handler);
+	};
+	for (const Pair<EntryID, PropertyID>& key : handler->subscription.properties) {
+		property_handlers[key].push_back(handler);
+		watch(key.first);
+	}
+	for (const EntryID& entry : handler->subscription.entries) {
+		entry_handlers[entry].push_back(handler);
+		watch(entry);
+	}
+}
+
+void WRL::remove_handler(EventHandler* handler) {
+	if (handler->subscription.is_all()) {
+		event_handlers.erase(handler);
+		return;
+	}
+	subscribed_handlers.erase(handler);
+	auto unwatch = [&](EntryID entry) {
+		Vector<EventHandler*>* watchers = entry_watchers.getptr(entry);
+		if (watchers) {
+			watchers->erase(handler);
+			if (watchers->is_empty())
+				entry_watchers.erase(entry);
+		}
+	};
+	for (const Pair<EntryID, PropertyID>& key : handler->subscription.properties) {
+		Vector<EventHandler*>* subscribed = property_handlers.getptr(key);
+		if (subscribed) {
+			subscribed->erase(handler);
+			if (subscribed->is_empty())
+				property_handlers.erase(key);
+		}
+		unwatch(key.first);
+	}
+	for (const EntryID& entry : handler->subscription.entries) {
+		Vector<EventHandler*>* subscribed = entry_handlers.getptr(entry);
+		if (subscribed) {
+			subscribed->erase(handler);
+			if (subscribed->is_empty())
+				entry_handlers.erase(entry);
+		}
+		unwatch(entry);
+	}
+}
@@ -3,13 +3,25 @@
 #include "core/io/file_access.h"
 #include "core/object/ref_counted.h"
 #include "core/templates/hash_map.h"
+#include "core/templates/list.h"
 #include "core/templates/pair.h"
 #include "core/templates/vector.h"
 
+class AssetManager;
+class ByteCursor;
+class ByteWriter;
+
 class WRL : public RefCounted {
 	GDCLASS(WRL, RefCounted);
 
   public:
+	// Index of a property in its entry's format
+	struct PropertyID {
+		int index = -1;
+		inline friend bool operator==(const PropertyID& lhs, const PropertyID& rhs) { return lhs.index == rhs.index; }
+		explicit operator bool() const { return index != -1; }
+	};
+
 	struct Format {
 		String type;
 		uint32_t u;
@@ -33,82 +45,210 @@ class WRL : public RefCounted {
 			Type type = Type::Prop;
 			Vector<String> uniforms;
 
-			explicit operator bool() const {
-				return !model.is_empty() || !position.is_empty() || !rotation.is_empty() || !scale.is_empty();
-			}
+			// Filled in from the names above when the format is registered
+			PropertyID model_id;
+			PropertyID position_id;
+			PropertyID rotation_id;
+			PropertyID scale_id;
+			Vector<PropertyID> uniform_ids;
+
+			explicit operator bool() const { return model_id || position_id || rotation_id || scale_id; }
 		};
 		Model model;
 
-		size_t find_property(const String& name) const;
+		PropertyID find_property(const String& name) const; // Throws std::out_of_range if there isn't one
+		void resolve_model();
 	};
 
+	// common_properties come first in every format
+	static constexpr PropertyID layer_property{0};
+	static constexpr PropertyID name_property{1};
+
 	struct EntryID {
 		int id = -1;
 		inline friend bool operator==(const EntryID& lhs, const EntryID& rhs) { return lhs.id == rhs.id; }
 		inline friend auto operator<=>(const EntryID& lhs, const EntryID& rhs) { return lhs.id <=> rhs.id; }
 		explicit operator bool() const { return id != -1; }
+
+		struct Hasher {
+			static _FORCE_INLINE_ uint32_t hash(const EntryID& key) { return HashMapHasherDefault::hash(key.id); }
+		};
+	};
+
+	// Every value of one property, a row per entry of the table. Only the vector matching type is used, strings and
+	// byte arrays are kept as the fixed size fields they are in the file.
+	struct Column {
+		Variant::Type type = Variant::NIL;
+		uint32_t length = 0; // Field size of string and byte columns, get_size() covers every type
+		Vector<uint32_t> ints;
+		Vector<float> floats;
+		Vector<Vector2> vector2s;
+		Vector<Vector3> vector3s;
+		Vector<Quaternion> quaternions;
+		Vector<uint8_t> bytes;
+
+		Variant get(int row) const;
+		String get_string(int row) const;
+		void set(int row, const Variant& value); // Throws std::invalid_argument if the type doesn't match
+		void append_default();
+		void resize(int rows);
+		void read(ByteCursor&, int row); // Into a row that already exists, safe to call for different rows at once
+		uint32_t get_size() const; // Bytes per row in the file
+		void store(ByteWriter&, int row) const;
+	};
+
+	// The entries of one format
+	struct Table {
+		const Format* format; // Interned, either from get_formats or raw_formats
+		Vector<Column> columns; // One per property of format
+		uint32_t row_size = 0; // Bytes per entry in the file, the total of the columns
+		Vector<EntryID> rows;
+	};
+
+	struct Location {
+		int table = -1;
+		int row = -1;
 	};
 
   private:
 	static Vector<Format::Property> common_properties;
 	static const HashMap<String, Format>& get_formats();
 
-	struct Entry {
-		Format format;
-		Vector<Variant> properties;
+	Vector<Table> tables;
+	HashMap<String, int> table_index; // Keyed by type, u and for unknown types the length of the data
+	List<Format> raw_formats; // Formats made up for unknown types, a List so the pointers stay put
+	int find_or_add_table(const Format*, const String& key);
+	void clear_entries(); // Without telling the handlers, for when they haven't been told about the entries
 
-		const Variant& get(const String& name) const;
-		template <class T> T get(const String& name) const { return get(name); };
-		void set(const String& name, const Variant& value);
-	};
-	Vector<Entry> entries;
+	Vector<Location> entries; // Indexed by EntryID::id
 	Vector<EntryID> scene;
-	bool regen_scene_map = true;
-	HashMap<int, EntryID> scene_map;
+	Vector<int> scene_index; // Position in scene of each entry, indexed by EntryID::id
+	HashMap<String, Vector<EntryID>> name_index; // Names aren't unique, so each can have a few entries
+	String get_name(EntryID id) const {
+		const Location& l = entries[id.id];
+		return tables[l.table].columns[name_property.index].get_string(l.row);
+	}
+	void index_name(EntryID);
+	void unindex_name(EntryID);
+
+	EntryID append_entry(int table);
+	void emit_added(EntryID);
 
   public:
-	Vector<EntryID> get_scene() { return scene.duplicate(); }
-	HashMap<int, EntryID> get_scene_map() {
-		if (regen_scene_map) {
-			scene_map.clear();
-			for (int i = 0; i < scene.size(); i++) {
-				scene_map.insert(i, scene[i]);
-			}
-			regen_scene_map = false;
-		}
-		return scene_map;
-	}
+	const Vector<EntryID>& get_scene() const { return scene; }
+
+	// For reading a property of many entries at once, straight from the columns
+	Location get_location(EntryID id) const { return entries[id.id]; }
+	const Table& get_table(int index) const { return tables[index]; }
 
-	int get_index(String name) const;
-	int get_index(EntryID id) const { return scene.find(id); }
+	int get_index(String name) const; // Of the first entry in the scene with the name
+	int get_index(EntryID id) const {
+		if (id.id < 0 || id.id >= scene_index.size())
+			return -1;
+		return scene_index[id.id];
+	}
 
-	const Format& get_entry_format(EntryID id) const;
-	Variant get_entry_property(EntryID id, String prop_name) const;
-	template <class T> T get_entry_property(EntryID id, String prop_name) const {
+	const Format& get_entry_format(EntryID id) const { return *tables[entries[id.id].table].format; }
+	Variant get_entry_property(EntryID id, PropertyID prop) const {
+		const Location& l = entries[id.id];
+		return tables[l.table].columns[prop.index].get(l.row);
+	}
+	template <class T> T get_entry_property(EntryID id, PropertyID prop) const { return get_entry_property(id, prop); }
+	// Looks the name up in the entry's format, prefer resolving a PropertyID once where it's called often
+	Variant get_entry_property(EntryID id, const String& prop_name) const {
+		return get_entry_property(id, get_entry_format(id).find_property(prop_name));
+	}
+	template <class T> T get_entry_property(EntryID id, const String& prop_name) const {
 		return get_entry_property(id, prop_name);
 	}
 
+	// Entries with their scene indices, iterated like a HashMap<int, EntryID>. Either a few entries, or the whole
+	// scene sharing the WRL's vector so that a world's worth costs nothing to pass around.
+	class EntrySet {
+	  public:
+		struct Item {
+			int key;
+			EntryID value;
+		};
+
+	  private:
+		Vector<EntryID> scene; // Every entry, from index 0
+		Vector<Item> items; // Otherwise
+		bool whole_scene = false;
+
+	  public:
+		EntrySet() = default;
+		explicit EntrySet(const Vector<EntryID>& p_scene) : scene(p_scene), whole_scene(true) {}
+
+		void insert(int index, EntryID id) {
+			DEV_ASSERT(!whole_scene);
+			items.push_back({index, id});
+		}
+		int size() const { return whole_scene ? scene.size() : items.size(); }
+		bool is_empty() const { return size() == 0; }
+		Item get(int i) const { return whole_scene ? Item{i, scene[i]} : items[i]; }
+
+		class ConstIterator {
+			const EntrySet* set;
+			int i;
+
+		  public:
+			ConstIterator(const EntrySet* p_set, int p_i) : set(p_set), i(p_i) {}
+			Item operator*() const { return set->get(i); }
+			ConstIterator& operator++() {
+				i++;
+				return *this;
+			}
+			bool operator!=(const ConstIterator& other) const { return i != other.i; }
+		};
+		ConstIterator begin() const { return ConstIterator(this, 0); }
+		ConstIterator end() const { return ConstIterator(this, size()); }
+	};
+
 	struct Change {
 		struct Hasher {
-			static _FORCE_INLINE_ uint32_t hash(const Pair<EntryID, String>& key) {
-				return ((key.first.id) + (key.second)).hash();
+			static _FORCE_INLINE_ uint32_t hash(const Pair<EntryID, PropertyID>& key) {
+				return HashMapHasherDefault::hash(uint64_t(uint32_t(key.first.id)) << 32 | uint32_t(key.second.index));
 			}
 		};
-		typedef HashMap<Pair<EntryID, String>, Variant, Hasher> PropertyMap;
+		typedef HashMap<Pair<EntryID, PropertyID>, Variant, Hasher> PropertyMap;
 		PropertyMap propertyChanges;
-		HashMap<int, EntryID> added;
-		HashMap<int, EntryID> removed;
+		// The properties of added entries aren't repeated in propertyChanges, read them from the WRL
+		EntrySet added;
+		EntrySet removed;
 		bool select_changed = false;
 		Pair<int, EntryID> select;
 	};
-	void submit_change(const Change&, String action_name = "");
+	// Property changes are recorded for undo under action_name. With merge a change is folded into the last action
+	// when that has the same name, so a drag is undone in one go.
+	void submit_change(const Change&, String action_name = "", bool merge = false);
+	// The same without recording an action, for changes that aren't the user's to undo such as a recovered journal
+	void apply_change(const Change&);
+
+	bool undo();
+	bool redo();
+	bool can_undo() const { return history_done > 0; }
+	bool can_redo() const { return history_done < history_size; }
+	String get_undo_name() const { return history_done > 0 ? history[history_slot(history_done - 1)].name : ""; }
+	String get_redo_name() const { return history_done < history_size ? history[history_slot(history_done)].name : ""; }
 
 	void select(EntryID);
 	void select(int index) { select(scene.get(index)); }
+	EntryID get_scene_entry(int index) const { return scene.get(index); }
+	int get_scene_size() const { return scene.size(); }
+
+	// Appends an entry of a known type, properties missing from values are left at their type's default
+	EntryID add_entry(const String& type, const HashMap<String, Variant>& values);
+	// The same with every property read from data, laid out as in a WRL chunk
+	EntryID add_entry_row(const String& type, ByteCursor& data);
+	void store_entry_row(EntryID, ByteWriter&) const;
 
 	void clear();
-	Error load(Ref<FileAccess> file);
-	Error save(Ref<FileAccess> file);
+	// Nothing is kept from a file that fails to load, the world is left empty. Large worlds are decoded across the
+	// threads of assets when it's given.
+	Error load(Ref<FileAccess> file, AssetManager* assets = nullptr);
+	Vector<uint8_t> save_to_buffer() const; // The whole file, for writing in one go
+	Error save(Ref<FileAccess> file) const;
 
   public:
 	class EventHandler {
@@ -116,10 +256,24 @@ class WRL : public RefCounted {
 		friend class WRL;
 		Ref<WRL> wrl;
 
+		// What the handler is sent, by default every change. A handler following only some properties or entries is
+		// sent just the changes that touch them, so an edit doesn't wake every widget. It still hears when any of its
+		// entries are added or removed, and every reset and selection change.
+		struct Subscription {
+			Vector<Pair<EntryID, PropertyID>> properties;
+			Vector<EntryID> entries; // Any property of these
+			bool is_all() const { return properties.is_empty() && entries.is_empty(); }
+		};
+		virtual Subscription get_subscription() const { return Subscription(); }
+
 		virtual void _wrl_changed(const Change&, bool reset = false) = 0;
 		virtual bool lite_init() { return false; }
 
+	  private:
+		Subscription subscription; // As it was when connected
+
 	  public:
+
 		void wrl_connect(Ref<WRL> p_wrl) {
 			if (wrl == p_wrl)
 				return;
@@ -127,16 +281,15 @@ class WRL : public RefCounted {
 			Change change;
 			if (wrl.is_valid()) {
 				if (!lite_init()) {
-					change.removed = wrl->get_scene_map();
+					change.removed = EntrySet(wrl->scene);
 				}
-				wrl->event_handlers.erase(this);
+				wrl->remove_handler(this);
 			};
 			wrl = p_wrl;
 			if (wrl.is_valid()) {
-				wrl->event_handlers.append(this);
+				wrl->add_handler(this);
 				if (!lite_init()) {
-					change.added = wrl->get_scene_map();
-					wrl->fixup_change(change);
+					change.added = EntrySet(wrl->scene);
 				}
 			}
 			this->_wrl_changed(change, true);
@@ -149,12 +302,32 @@ class WRL : public RefCounted {
 
 		~EventHandler() {
 			if (wrl.is_valid())
-				wrl->event_handlers.erase(this);
+				wrl->remove_handler(this);
 		}
 	};
 
   private:
-	void fixup_change(Change&);
-	void emit_change(Change change, bool reset = false);
-	Vector<EventHandler*> event_handlers;
+	// The old and new values of the properties an action changed, undo applies before and redo after
+	struct Action {
+		String name;
+		Change::PropertyMap before;
+		Change::PropertyMap after;
+	};
+	static constexpr int history_capacity = 512; // The oldest actions are dropped past this
+	Vector<Action> history; // Ring buffer once it reaches history_capacity
+	int history_start = 0; // Slot of the oldest action
+	int history_size = 0; // Actions held, including undone ones
+	int history_done = 0; // Actions applied, the ones after can be redone
+	int history_slot(int action) const { return (history_start + action) % history_capacity; }
+	void record_action(const Change::PropertyMap&, const String& name, bool merge);
+	void set_properties(const Change::PropertyMap&);
+
+	void emit_change(const Change& change, bool reset = false);
+	Vector<EventHandler*> event_handlers; // Sent every change
+	Vector<EventHandler*> subscribed_handlers; // The rest, sent what their subscriptions pick out
+	HashMap<Pair<EntryID, PropertyID>, Vector<EventHandler*>, Change::Hasher> property_handlers;
+	HashMap<EntryID, Vector<EventHandler*>, EntryID::Hasher> entry_handlers;
+	HashMap<EntryID, Vector<EventHandler*>, EntryID::Hasher> entry_watchers; // Any subscription naming the entry
+	void add_handler(EventHandler*);
+	void remove_handler(EventHandler*);
 };
\ No newline at end of file
@@ -181,6 +181,7 @@ const HashMap<String, WRL::Format>& WRL::get_formats() {
 			auto unique_properties = format.properties;
 			format.properties = common_properties.duplicate();
 			format.properties.append_array(unique_properties);
+			format.resolve_model();
 			formats.insert(format.type, format);
 		}
 	}